@@ -56,6 +56,27 @@ __subsystem struct behavior_driver_api {
  * @endcond
  */
 
+/**
+ * @brief Get the behavior device of a binding
+ *
+ * The device is only looked up by name the first time, and is then cached in the binding, so
+ * behaviors keep the bindings they invoke in their data rather than in their const config.
+ * Behaviors may resolve those bindings when they initialise, to save the lookup on first use.
+ * device_get_binding() only finds devices that have already initialised, so bindings to behaviors
+ * that initialise later are still resolved when they are first used.
+ * @param binding Pointer to the binding to resolve
+ *
+ * @retval Pointer to the behavior device, or NULL if no behavior has the binding's name.
+ */
+static inline const struct device *
+behavior_binding_get_device(struct zmk_behavior_binding *binding) {
+    if (binding->dev == NULL) {
+        binding->dev = device_get_binding(binding->behavior_dev);
+    }
+
+    return binding->dev;
+}
+
 /**
  * @brief Handle the keymap binding which needs to be converted from relative "toggle" to absolute
  * "turn on"
@@ -70,7 +91,7 @@ __syscall int behavior_keymap_binding_convert_central_state_dependent_params(
 
 static inline int z_impl_behavior_keymap_binding_convert_central_state_dependent_params(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
     const struct behavior_driver_api *api = (const struct behavior_driver_api *)dev->api;
 
     if (api->binding_convert_central_state_dependent_params == NULL) {
@@ -116,7 +137,7 @@ __syscall int behavior_keymap_binding_pressed(struct zmk_behavior_binding *bindi
 
 static inline int z_impl_behavior_keymap_binding_pressed(struct zmk_behavior_binding *binding,
                                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
@@ -144,7 +165,7 @@ __syscall int behavior_keymap_binding_released(struct zmk_behavior_binding *bind
 
 static inline int z_impl_behavior_keymap_binding_released(struct zmk_behavior_binding *binding,
                                                           struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
@@ -178,7 +199,7 @@ static inline int z_impl_behavior_sensor_keymap_binding_accept_data(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event,
     const struct zmk_sensor_config *sensor_config, size_t channel_data_size,
     const struct zmk_sensor_channel_data *channel_data) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
@@ -214,7 +235,7 @@ static inline int
 z_impl_behavior_sensor_keymap_binding_process(struct zmk_behavior_binding *binding,
                                               struct zmk_behavior_binding_event event,
                                               enum behavior_sensor_binding_process_mode mode) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
@@ -37,3 +37,6 @@
 #define BEHAVIOR_MACRO_PARAM_2TO1            30
 #define BEHAVIOR_MACRO_PARAM_2TO2            31
 #define BEHAVIOR_ANIMATION                   32
+#define BEHAVIOR_MOUSE_KEY_PRESS             33
+#define BEHAVIOR_MOUSE_MOVE                  34
+#define BEHAVIOR_MOUSE_SCROLL                35
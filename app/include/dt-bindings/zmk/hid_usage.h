@@ -2568,3 +2568,5 @@
 /* Page 0xFF00: ZMK Specific (Vendor defined) */
 #define HID_USAGE_ZMK_UNDEFINED (0x00)
 #define HID_USAGE_ZMK_KEYMAP (0x01)			// DV
+#define HID_USAGE_ZMK_EVENT_TRACE (0x02)		// DV
+#define HID_USAGE_ZMK_DECISION_STATS (0x03)		// DV
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+/* Mouse press behavior */
+/* Left click */
+#define MB1 (0x01)
+#define LCLK (MB1)
+
+/* Right click */
+#define MB2 (0x02)
+#define RCLK (MB2)
+
+/* Middle click */
+#define MB3 (0x04)
+#define MCLK (MB3)
+
+#define MB4 (0x08)
+#define MB5 (0x10)
+#define MB6 (0x20)
+#define MB7 (0x40)
+#define MB8 (0x80)
+
+/*
+ * Mouse move and scroll behaviors. The parameter holds the top speed of each axis, X in the low
+ * half and Y in the high half, as signed 16 bit values. Move speeds are in pixels per second, and
+ * scroll speeds in wheel detents per second; for scrolling, Y is the wheel and X is the pan.
+ */
+#define MOVE_Y(vert) (((vert)&0xFFFF) << 16)
+#define MOVE_X(hor) ((hor)&0xFFFF)
+#define MOVE(hor, vert) (MOVE_X(hor) + MOVE_Y(vert))
+
+#define MOVE_UP MOVE_Y(-600)
+#define MOVE_DOWN MOVE_Y(600)
+#define MOVE_LEFT MOVE_X(-600)
+#define MOVE_RIGHT MOVE_X(600)
+
+#define SCRL_UP MOVE_Y(10)
+#define SCRL_DOWN MOVE_Y(-10)
+#define SCRL_LEFT MOVE_X(-10)
+#define SCRL_RIGHT MOVE_X(10)
@@ -11,6 +11,9 @@
 
 struct zmk_behavior_binding {
     const char *behavior_dev;
+    // Device named by behavior_dev, looked up on first use. Must be reset to NULL whenever
+    // behavior_dev is changed. Only valid for the current boot, so bindings are never stored as is.
+    const struct device *dev;
     uint32_t param1;
     uint32_t param2;
 };
@@ -29,6 +29,11 @@ int zmk_ble_active_profile_index();
 bt_addr_le_t *zmk_ble_active_profile_addr();
 bool zmk_ble_active_profile_is_open();
 bool zmk_ble_active_profile_is_connected();
+/**
+ * Gets the connection interval of the active profile, rounded up to whole milliseconds.
+ * @retval -ENOTCONN If the active profile is not connected.
+ */
+int zmk_ble_active_profile_conn_interval_ms();
 char *zmk_ble_active_profile_name();
 
 int zmk_ble_unpair_all();
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+#include <zmk/event_manager.h>
+#include <zmk/matrix.h>
+
+#define ZMK_CAPTURE_BUFFER_POSITION_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)
+
+struct zmk_capture_buffer_stats {
+    // Highest number of slots in use at the same time
+    uint32_t high_water;
+    // Number of events that could not be captured because the buffer was full
+    uint32_t overflows;
+};
+
+/**
+ * Ring buffer of captured events that are released, in order, through the event manager later.
+ *
+ * Events are captured into the current segment. Releasing a segment starts a new one, so events
+ * captured again while the previous segment is being released (e.g. by the next hold-tap) are
+ * kept apart from it, and are released before the rest of the previous segment once their own
+ * segment is released.
+ *
+ * Slots are addressed by sequence numbers that restart at zero whenever the buffer is empty.
+ */
+struct zmk_capture_buffer {
+    const zmk_event_t **events;
+    uint32_t size;
+    // Oldest slot that may still hold an event
+    uint32_t head;
+    // First slot of the current segment
+    uint32_t segment;
+    // Next free slot
+    uint32_t tail;
+    // Positions with a key down event in the current segment
+    uint32_t keydowns[ZMK_CAPTURE_BUFFER_POSITION_WORDS];
+    struct zmk_capture_buffer_stats stats;
+};
+
+#define ZMK_CAPTURE_BUFFER_DEFINE(name, depth)                                                     \
+    static const zmk_event_t *_CONCAT(name, _events)[depth];                                       \
+    static struct zmk_capture_buffer name = {.events = _CONCAT(name, _events), .size = depth}
+
+typedef void (*zmk_capture_buffer_release_t)(const zmk_event_t *event, size_t index);
+
+/**
+ * @brief Capture an event into the current segment
+ * @retval 0 If successful.
+ * @retval -ENOMEM If the buffer is full. The event is not captured, and the overflow is counted.
+ */
+int zmk_capture_buffer_push(struct zmk_capture_buffer *buf, const zmk_event_t *event);
+
+/**
+ * @brief Remove the oldest event of the current segment without releasing it
+ * @retval The event, or NULL if the current segment is empty.
+ */
+const zmk_event_t *zmk_capture_buffer_take(struct zmk_capture_buffer *buf);
+
+/**
+ * @brief Release all events of the current segment
+ *
+ * The events are removed from the buffer before the release function is called with each of
+ * them, oldest first, so the release function may capture them again.
+ * @param release Function that hands an event back to the event manager
+ * @retval The number of released events.
+ */
+size_t zmk_capture_buffer_release(struct zmk_capture_buffer *buf,
+                                  zmk_capture_buffer_release_t release);
+
+static inline size_t zmk_capture_buffer_segment_len(const struct zmk_capture_buffer *buf) {
+    return buf->tail - buf->segment;
+}
+
+/**
+ * @brief Check in constant time whether the current segment holds a key down event for a position
+ */
+static inline bool zmk_capture_buffer_has_keydown(const struct zmk_capture_buffer *buf,
+                                                  uint32_t position) {
+    return position < ZMK_KEYMAP_LEN && (buf->keydowns[position / 32] & BIT(position % 32));
+}
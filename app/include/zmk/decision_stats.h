@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+// Bucket 0 counts decisions made within a millisecond, bucket b counts decisions that took
+// [2^(b-1), 2^b) ms, and the last bucket also counts everything slower.
+#define ZMK_DECISION_STATS_BUCKETS 12
+
+/**
+ * Latency histograms of the decisions made by one instance of a timing behavior (a hold-tap or a
+ * combo), with one histogram per decision reason. The latency is the time from the key press that
+ * started the decision until the decision was made, which is the delay added to the key events
+ * held back in the meantime.
+ */
+struct zmk_decision_stats {
+    const char *name;
+    const char *const *reasons;
+    uint8_t reason_count;
+    // reason_count histograms of ZMK_DECISION_STATS_BUCKETS counters each
+    uint32_t *buckets;
+};
+
+#if IS_ENABLED(CONFIG_ZMK_DECISION_STATS)
+
+#define ZMK_DECISION_STATS_DEFINE(var, instance_name, reason_names)                                \
+    static uint32_t _CONCAT(var, _buckets)[ARRAY_SIZE(reason_names) * ZMK_DECISION_STATS_BUCKETS]; \
+    static const struct zmk_decision_stats var = {                                                 \
+        .name = instance_name,                                                                     \
+        .reasons = reason_names,                                                                   \
+        .reason_count = ARRAY_SIZE(reason_names),                                                  \
+        .buckets = _CONCAT(var, _buckets),                                                         \
+    };                                                                                             \
+    static const struct zmk_decision_stats *_CONCAT(var, _ref) __used                              \
+        __attribute__((__section__(".decision_stats"))) = &var
+
+#define ZMK_DECISION_STATS_REF(var) (&var)
+
+/**
+ * @brief Count a decision
+ * @param stats The instance that made the decision, may be NULL
+ * @param reason Index of the reason in the reason names of the instance
+ * @param latency_ms Time from the start of the decision until now
+ */
+void zmk_decision_stats_record(const struct zmk_decision_stats *stats, uint8_t reason,
+                               int64_t latency_ms);
+
+/**
+ * @brief Get the instance at an index, in link order
+ * @retval The instance, or NULL if the index is past the last instance.
+ */
+const struct zmk_decision_stats *zmk_decision_stats_get(size_t index);
+
+void zmk_decision_stats_reset();
+
+#else
+
+// Only declared, so the trailing semicolon of a definition stays valid.
+#define ZMK_DECISION_STATS_DEFINE(var, instance_name, reason_names)                                \
+    extern const struct zmk_decision_stats var
+#define ZMK_DECISION_STATS_REF(var) NULL
+
+static inline void zmk_decision_stats_record(const struct zmk_decision_stats *stats,
+                                             uint8_t reason, int64_t latency_ms) {}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_DECISION_STATS) */
@@ -57,4 +57,4 @@ int zmk_display_init();
         }                                                                                          \
         return ZMK_EV_EVENT_BUBBLE;                                                                \
     }                                                                                              \
-    ZMK_LISTENER(listener, listener##_cb);
+    ZMK_LISTENER_DEFERRED(listener, listener##_cb);
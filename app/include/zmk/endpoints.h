@@ -68,4 +68,24 @@ int zmk_endpoints_toggle_transport(void);
  */
 struct zmk_endpoint_instance zmk_endpoints_selected(void);
 
+/**
+ * Sends the current report for a usage page to the selected endpoint. Inside a batch, the report
+ * is only sent once the batch ends, unless it must go out earlier for the host to see every change.
+ * Reports that equal the last report sent are dropped.
+ */
 int zmk_endpoints_send_report(uint16_t usage_page);
+
+/**
+ * Sends the current mouse report to the selected endpoint right away, even inside a batch, since
+ * its motion is relative to the previous report.
+ * @retval -EAGAIN If the transport has no room for the report yet. Nothing was sent.
+ */
+int zmk_endpoints_send_mouse_report(void);
+
+/**
+ * Starts a batch of input, e.g. all key events from one matrix scan, so the reports it changes are
+ * sent once rather than once per event. Batches may be nested; the reports are sent when the
+ * outermost one ends.
+ */
+void zmk_endpoints_batch_begin(void);
+int zmk_endpoints_batch_end(void);
@@ -10,11 +10,29 @@
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
 
+// Range of the (type sorted) subscription section that holds the subscribers of one event type.
+// Filled in once at boot, so dispatch only visits listeners that subscribed to the event.
+struct zmk_event_subscribers {
+    uint8_t start;
+    uint8_t end;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_ASYNC)
+    // Most recent copy of a non-capturable event still waiting for its deferred listeners
+    struct zmk_event_header *pending;
+#endif
+};
+
 struct zmk_event_type {
     const char *name;
+    struct zmk_event_subscribers *subscribers;
+    // Size of the whole event, header included
+    uint16_t size;
+    uint8_t flags;
+    // Merges the payload of a newer latest value event into the one still waiting for the deferred
+    // listeners. If NULL, the newer payload replaces it.
+    void (*merge)(void *pending, const void *newer);
 };
 
-typedef struct {
+typedef struct zmk_event_header {
     const struct zmk_event_type *event;
     uint8_t last_listener_index;
 } zmk_event_t;
@@ -26,44 +44,115 @@ typedef struct {
 typedef int (*zmk_listener_callback_t)(const zmk_event_t *eh);
 struct zmk_listener {
     zmk_listener_callback_t callback;
+    uint8_t flags;
 };
 
+// Deferred listeners are cosmetic (display, lighting, statistics) and never capture or handle
+// events. With CONFIG_ZMK_EVENT_MANAGER_ASYNC they are skipped while the event is dispatched to
+// the input critical listeners, and are invoked afterwards from the low priority work queue.
+// They still receive an event that a later listener captures, even if it is never released.
+#define ZMK_LISTENER_FLAG_DEFERRED BIT(0)
+
 struct zmk_event_subscription {
     const struct zmk_event_type *event_type;
     const struct zmk_listener *listener;
 };
 
-#define ZMK_EVENT_DECLARE(event_type)                                                              \
+#define ZMK_EVENT_TYPE_FLAG_NON_CAPTURABLE BIT(0)
+// Only the latest value of the event matters to deferred listeners, so an event still waiting
+// for them is overwritten by a newer one instead of being delivered twice.
+#define ZMK_EVENT_TYPE_FLAG_LATEST_VALUE BIT(1)
+
+#define Z_ZMK_EVENT_DECLARE_COMMON(event_type)                                                     \
     struct event_type##_event {                                                                    \
         zmk_event_t header;                                                                        \
         struct event_type data;                                                                    \
     };                                                                                             \
-    struct event_type##_event *new_##event_type(struct event_type);                                \
     struct event_type *as_##event_type(const zmk_event_t *eh);                                     \
     extern const struct zmk_event_type zmk_event_##event_type;
 
-#define ZMK_EVENT_IMPL(event_type)                                                                 \
-    const struct zmk_event_type zmk_event_##event_type = {.name = STRINGIFY(event_type)};          \
+#define ZMK_EVENT_DECLARE(event_type)                                                              \
+    Z_ZMK_EVENT_DECLARE_COMMON(event_type)                                                         \
+    struct event_type##_event *new_##event_type(struct event_type);
+
+// Events of a non-capturable type are never captured by a listener, so they are dispatched
+// from a stack object owned by raise_<event_type>() instead of being allocated.
+#define ZMK_EVENT_DECLARE_NON_CAPTURABLE(event_type)                                               \
+    Z_ZMK_EVENT_DECLARE_COMMON(event_type)                                                         \
+    int raise_##event_type(struct event_type);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+#define ZMK_EVENT_CHECK_SIZE(event_type)                                                           \
+    BUILD_ASSERT(sizeof(struct event_type##_event) <= CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCK_SIZE,    \
+                 STRINGIFY(event_type) " does not fit in an event slab block, increase "           \
+                                       "CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCK_SIZE");
+#else
+#define ZMK_EVENT_CHECK_SIZE(event_type)
+#endif
+
+#define Z_ZMK_EVENT_IMPL_COMMON(event_type, type_flags, merge_fn)                                  \
+    static struct zmk_event_subscribers zmk_event_subscribers_##event_type;                        \
+    const struct zmk_event_type zmk_event_##event_type = {                                         \
+        .name = STRINGIFY(event_type),                                                             \
+        .subscribers = &zmk_event_subscribers_##event_type,                                        \
+        .size = sizeof(struct event_type##_event),                                                 \
+        .flags = type_flags,                                                                       \
+        .merge = merge_fn,                                                                         \
+    };                                                                                             \
     const struct zmk_event_type *zmk_event_ref_##event_type __used                                 \
         __attribute__((__section__(".event_type"))) = &zmk_event_##event_type;                     \
+    struct event_type *as_##event_type(const zmk_event_t *eh) {                                    \
+        return (eh->event == &zmk_event_##event_type) ? &((struct event_type##_event *)eh)->data   \
+                                                      : NULL;                                      \
+    };
+
+#define ZMK_EVENT_IMPL(event_type)                                                                 \
+    ZMK_EVENT_CHECK_SIZE(event_type)                                                               \
+    Z_ZMK_EVENT_IMPL_COMMON(event_type, 0, NULL)                                                   \
     struct event_type##_event *new_##event_type(struct event_type data) {                          \
-        struct event_type##_event *ev =                                                            \
-            (struct event_type##_event *)k_malloc(sizeof(struct event_type##_event));              \
+        struct event_type##_event *ev = (struct event_type##_event *)zmk_event_manager_alloc(      \
+            sizeof(struct event_type##_event));                                                    \
         ev->header.event = &zmk_event_##event_type;                                                \
+        ev->header.last_listener_index = 0;                                                        \
         ev->data = data;                                                                           \
         return ev;                                                                                 \
-    };                                                                                             \
-    struct event_type *as_##event_type(const zmk_event_t *eh) {                                    \
-        return (eh->event == &zmk_event_##event_type) ? &((struct event_type##_event *)eh)->data   \
-                                                      : NULL;                                      \
     };
 
+#define Z_ZMK_EVENT_IMPL_RAISE(event_type, type_flags, merge_fn)                                   \
+    Z_ZMK_EVENT_IMPL_COMMON(event_type, ZMK_EVENT_TYPE_FLAG_NON_CAPTURABLE | (type_flags),         \
+                            merge_fn)                                                              \
+    int raise_##event_type(struct event_type data) {                                               \
+        struct event_type##_event ev = {                                                           \
+            .header = {.event = &zmk_event_##event_type, .last_listener_index = 0},                \
+            .data = data,                                                                          \
+        };                                                                                         \
+        return zmk_event_manager_raise(&ev.header);                                                \
+    };
+
+#define ZMK_EVENT_IMPL_NON_CAPTURABLE(event_type) Z_ZMK_EVENT_IMPL_RAISE(event_type, 0, NULL)
+
+// Latest value events are non-capturable events that carry (or make listeners fetch) the whole
+// current state, so deferred listeners only need to see the last one raised.
+#define ZMK_EVENT_IMPL_LATEST_VALUE(event_type)                                                    \
+    Z_ZMK_EVENT_IMPL_RAISE(event_type, ZMK_EVENT_TYPE_FLAG_LATEST_VALUE, NULL)
+
+// Latest value events whose payload also describes what changed since the previous event, so a
+// newer event is combined with the one still waiting by merge_fn(pending, newer) instead.
+#define ZMK_EVENT_IMPL_LATEST_VALUE_MERGE(event_type, merge_fn)                                    \
+    Z_ZMK_EVENT_IMPL_RAISE(event_type, ZMK_EVENT_TYPE_FLAG_LATEST_VALUE, merge_fn)
+
 #define ZMK_LISTENER(mod, cb) const struct zmk_listener zmk_listener_##mod = {.callback = cb};
 
+#define ZMK_LISTENER_DEFERRED(mod, cb)                                                             \
+    const struct zmk_listener zmk_listener_##mod = {.callback = cb,                                \
+                                                    .flags = ZMK_LISTENER_FLAG_DEFERRED};
+
+// Subscriptions are placed in a per event type input section, which the linker sorts by name so
+// that all subscribers of an event type are contiguous, while keeping their relative link order.
 #define ZMK_SUBSCRIPTION(mod, ev_type)                                                             \
     const Z_DECL_ALIGN(struct zmk_event_subscription)                                              \
         _CONCAT(_CONCAT(zmk_event_sub_, mod), ev_type) __used                                      \
-        __attribute__((__section__(".event_subscription"))) = {                                    \
+        __attribute__((__section__(".event_subscription." STRINGIFY(ev_type)))) = {                \
             .event_type = &zmk_event_##ev_type,                                                    \
             .listener = &zmk_listener_##mod,                                                       \
     };
@@ -78,7 +167,47 @@ struct zmk_event_subscription {
 
 #define ZMK_EVENT_RELEASE(ev) zmk_event_manager_release((zmk_event_t *)ev);
 
-#define ZMK_EVENT_FREE(ev) k_free((void *)ev);
+#define ZMK_EVENT_FREE(ev) zmk_event_manager_free((zmk_event_t *)ev);
+
+struct zmk_event_manager_alloc_stats {
+    // Number of slab blocks currently handed out
+    uint32_t slab_used;
+    // Highest number of slab blocks handed out at the same time
+    uint32_t slab_high_water;
+    // Number of allocations that fell back to the heap because the slab was exhausted
+    uint32_t heap_fallbacks;
+};
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+
+struct zmk_event_trace_entry {
+    const struct zmk_event_type *event_type;
+    // Time spent in the listener callback, in hardware cycles
+    uint32_t cycles;
+    uint8_t listener_index;
+    // ZMK_EV_EVENT_* value returned by the listener, or a negative error
+    int8_t result;
+};
+
+/**
+ * @brief Read recorded dispatches from the event trace
+ *
+ * Copies trace entries starting at the given sequence number. If the requested entries have
+ * already been overwritten, reading resumes at the oldest entry still in the buffer. Reading stops
+ * at an entry that is still being written, so only complete entries are copied.
+ * @param sequence sequence number to start reading at, updated to the next unread entry
+ * @param entries buffer to copy entries into
+ * @param len maximum number of entries to copy
+ * @return number of entries copied
+ */
+int zmk_event_manager_trace_read(uint32_t *sequence, struct zmk_event_trace_entry *entries,
+                                 size_t len);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE) */
+
+void *zmk_event_manager_alloc(size_t size);
+void zmk_event_manager_free(zmk_event_t *event);
+void zmk_event_manager_get_alloc_stats(struct zmk_event_manager_alloc_stats *stats);
 
 int zmk_event_manager_raise(zmk_event_t *event);
 int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener);
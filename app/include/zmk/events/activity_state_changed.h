@@ -14,4 +14,4 @@ struct zmk_activity_state_changed {
     enum zmk_activity_state state;
 };
 
-ZMK_EVENT_DECLARE(zmk_activity_state_changed);
\ No newline at end of file
+ZMK_EVENT_DECLARE_NON_CAPTURABLE(zmk_activity_state_changed);
\ No newline at end of file
@@ -14,4 +14,4 @@ struct zmk_battery_state_changed {
     uint8_t state_of_charge;
 };
 
-ZMK_EVENT_DECLARE(zmk_battery_state_changed);
\ No newline at end of file
+ZMK_EVENT_DECLARE_NON_CAPTURABLE(zmk_battery_state_changed);
\ No newline at end of file
@@ -8,17 +8,29 @@
 
 #include <zephyr/kernel.h>
 #include <zmk/event_manager.h>
+#include <zmk/keymap.h>
 
 struct zmk_layer_state_changed {
+    // Highest layer that changed, and whether it was activated. Several layers can change in a
+    // single event, use the old and new states to see all of them.
     uint8_t layer;
     bool state;
     int64_t timestamp;
+    zmk_keymap_layers_state_t old_state;
+    zmk_keymap_layers_state_t new_state;
 };
 
-ZMK_EVENT_DECLARE(zmk_layer_state_changed);
+ZMK_EVENT_DECLARE_NON_CAPTURABLE(zmk_layer_state_changed);
 
-static inline struct zmk_layer_state_changed_event *create_layer_state_changed(uint8_t layer,
-                                                                               bool state) {
-    return new_zmk_layer_state_changed((struct zmk_layer_state_changed){
-        .layer = layer, .state = state, .timestamp = k_uptime_get()});
+static inline int raise_layer_state_changed(zmk_keymap_layers_state_t old_state,
+                                            zmk_keymap_layers_state_t new_state) {
+    int layer = zmk_keymap_layers_highest(old_state ^ new_state);
+
+    return raise_zmk_layer_state_changed((struct zmk_layer_state_changed){
+        .layer = layer,
+        .state = (new_state & ZMK_KEYMAP_LAYER_BIT(layer)) != 0,
+        .timestamp = k_uptime_get(),
+        .old_state = old_state,
+        .new_state = new_state,
+    });
 }
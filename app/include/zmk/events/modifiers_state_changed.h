@@ -15,4 +15,4 @@ struct zmk_modifiers_state_changed {
     bool state;
 };
 
-ZMK_EVENT_DECLARE(zmk_modifiers_state_changed);
\ No newline at end of file
+ZMK_EVENT_DECLARE_NON_CAPTURABLE(zmk_modifiers_state_changed);
\ No newline at end of file
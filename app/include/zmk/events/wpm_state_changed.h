@@ -14,4 +14,4 @@ struct zmk_wpm_state_changed {
     int state;
 };
 
-ZMK_EVENT_DECLARE(zmk_wpm_state_changed);
+ZMK_EVENT_DECLARE_NON_CAPTURABLE(zmk_wpm_state_changed);
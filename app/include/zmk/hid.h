@@ -10,7 +10,9 @@
 #include <zephyr/usb/class/usb_hid.h>
 
 #include <zmk/keys.h>
+#include <zmk/mouse.h>
 #include <zmk/matrix.h>
+#include <zmk/decision_stats.h>
 #include <dt-bindings/zmk/hid_usage.h>
 #include <dt-bindings/zmk/hid_usage_pages.h>
 
@@ -22,6 +24,9 @@
     HID_ITEM(HID_ITEM_TAG_USAGE_PAGE, HID_ITEM_TYPE_GLOBAL, 2), \
     (page & 0xFF), ((page & 0xFF00) >> 8)
 
+#define HID_USAGE16(idx)                                                                           \
+    HID_ITEM(HID_ITEM_TAG_USAGE, HID_ITEM_TYPE_LOCAL, 2), (idx & 0xFF), ((idx & 0xFF00) >> 8)
+
 #define HID_INPUT_REPORT_TYPE 0x1
 #define HID_OUTPUT_REPORT_TYPE 0x2
 #define HID_FEATURE_REPORT_TYPE 0x3
@@ -31,6 +36,20 @@
 #define SETTINGS_REPORT_ID_KEY_SEL 0x5
 #define SETTINGS_REPORT_ID_KEY_DATA 0x6
 #define SETTINGS_REPORT_ID_KEY_COMMIT 0x7
+#define EVENT_TRACE_REPORT_ID 0x8
+#define DECISION_STATS_REPORT_ID 0x9
+#define MOUSE_REPORT_ID 0xA
+
+#define ZMK_HID_MOUSE_NUM_BUTTONS 0x08
+
+/* Number of event manager trace entries returned by each event trace feature report */
+#define ZMK_HID_EVENT_TRACE_REPORT_ENTRIES 6
+#define ZMK_HID_EVENT_TRACE_REPORT_BODY_SIZE (5 + (7 * ZMK_HID_EVENT_TRACE_REPORT_ENTRIES))
+
+/* Length of the instance name in decision stats feature reports, which is truncated to fit */
+#define ZMK_HID_DECISION_STATS_NAME_LEN 16
+#define ZMK_HID_DECISION_STATS_REPORT_BODY_SIZE                                                    \
+    (3 + ZMK_HID_DECISION_STATS_NAME_LEN + (4 * ZMK_DECISION_STATS_BUCKETS))
 
 static const uint8_t zmk_hid_report_desc[] = {
     HID_USAGE_PAGE(HID_USAGE_GEN_DESKTOP),
@@ -119,6 +138,46 @@ static const uint8_t zmk_hid_report_desc[] = {
     /* INPUT report (Data,Var,Abs) */
     HID_INPUT(0x02),
     HID_END_COLLECTION,
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    HID_USAGE_PAGE(HID_USAGE_GD),
+    HID_USAGE(HID_USAGE_GD_MOUSE),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+    HID_REPORT_ID(MOUSE_REPORT_ID),
+    HID_USAGE(HID_USAGE_GD_POINTER),
+    HID_COLLECTION(HID_COLLECTION_PHYSICAL),
+    HID_USAGE_PAGE(HID_USAGE_BUTTON),
+    HID_USAGE_MIN8(0x01),
+    HID_USAGE_MAX8(ZMK_HID_MOUSE_NUM_BUTTONS),
+    HID_LOGICAL_MIN8(0x00),
+    HID_LOGICAL_MAX8(0x01),
+    HID_REPORT_SIZE(0x01),
+    HID_REPORT_COUNT(ZMK_HID_MOUSE_NUM_BUTTONS),
+    /* INPUT (Data,Var,Abs) */
+    HID_INPUT(0x02),
+    HID_USAGE_PAGE(HID_USAGE_GD),
+    HID_USAGE(HID_USAGE_GD_X),
+    HID_USAGE(HID_USAGE_GD_Y),
+    HID_LOGICAL_MIN16(0x01, 0x80),
+    HID_LOGICAL_MAX16(0xFF, 0x7F),
+    HID_REPORT_SIZE(0x10),
+    HID_REPORT_COUNT(0x02),
+    /* INPUT (Data,Var,Rel) */
+    HID_INPUT(0x06),
+    HID_USAGE(HID_USAGE_GD_WHEEL),
+    HID_LOGICAL_MIN8(0x81),
+    HID_LOGICAL_MAX8(0x7F),
+    HID_REPORT_SIZE(0x08),
+    HID_REPORT_COUNT(0x01),
+    /* INPUT (Data,Var,Rel) */
+    HID_INPUT(0x06),
+    HID_USAGE_PAGE(HID_USAGE_CONSUMER),
+    HID_USAGE16(HID_USAGE_CONSUMER_AC_PAN),
+    HID_REPORT_COUNT(0x01),
+    /* INPUT (Data,Var,Rel) */
+    HID_INPUT(0x06),
+    HID_END_COLLECTION,
+    HID_END_COLLECTION,
+#endif /* CONFIG_ZMK_MOUSE */
 #if IS_ENABLED(CONFIG_ZMK_SETTINGS)
     HID_USAGE_PAGE16(HID_USAGE_VENDOR),
     HID_USAGE(HID_USAGE_ZMK_KEYMAP),
@@ -151,6 +210,34 @@ static const uint8_t zmk_hid_report_desc[] = {
     HID_FEATURE(0x2),
     HID_END_COLLECTION,
 #endif /* CONFIG_ZMK_SETTINGS */
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE_FEATURE_REPORT)
+    HID_USAGE_PAGE16(HID_USAGE_VENDOR),
+    HID_USAGE(HID_USAGE_ZMK_EVENT_TRACE),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+    HID_USAGE(HID_USAGE_ZMK_EVENT_TRACE),
+    HID_REPORT_ID(EVENT_TRACE_REPORT_ID),
+    HID_LOGICAL_MIN8(0x00),
+    HID_LOGICAL_MAX16(0xFF, 0x00),
+    HID_REPORT_SIZE(0x08),
+    HID_REPORT_COUNT(ZMK_HID_EVENT_TRACE_REPORT_BODY_SIZE),
+    /* Feature (Data,Var,Abs) */
+    HID_FEATURE(0x2),
+    HID_END_COLLECTION,
+#endif /* CONFIG_ZMK_EVENT_MANAGER_TRACE_FEATURE_REPORT */
+#if IS_ENABLED(CONFIG_ZMK_DECISION_STATS_FEATURE_REPORT)
+    HID_USAGE_PAGE16(HID_USAGE_VENDOR),
+    HID_USAGE(HID_USAGE_ZMK_DECISION_STATS),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+    HID_USAGE(HID_USAGE_ZMK_DECISION_STATS),
+    HID_REPORT_ID(DECISION_STATS_REPORT_ID),
+    HID_LOGICAL_MIN8(0x00),
+    HID_LOGICAL_MAX16(0xFF, 0x00),
+    HID_REPORT_SIZE(0x08),
+    HID_REPORT_COUNT(ZMK_HID_DECISION_STATS_REPORT_BODY_SIZE),
+    /* Feature (Data,Var,Abs) */
+    HID_FEATURE(0x2),
+    HID_END_COLLECTION,
+#endif /* CONFIG_ZMK_DECISION_STATS_FEATURE_REPORT */
 };
 
 // struct zmk_hid_boot_report
@@ -197,6 +284,24 @@ struct zmk_hid_gen_desktop_report {
     struct zmk_hid_gen_desktop_report_body body;
 } __packed;
 
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+
+/* Motion is relative to the previous report, so unlike the other reports, each one is a change */
+struct zmk_hid_mouse_report_body {
+    zmk_mouse_button_flags_t buttons;
+    int16_t d_x;
+    int16_t d_y;
+    int8_t d_wheel;
+    int8_t d_pan;
+} __packed;
+
+struct zmk_hid_mouse_report {
+    uint8_t report_id;
+    struct zmk_hid_mouse_report_body body;
+} __packed;
+
+#endif /* IS_ENABLED(CONFIG_ZMK_MOUSE) */
+
 #if IS_ENABLED(CONFIG_SETTINGS)
 
 struct zmk_hid_vendor_functions_report_body {
@@ -246,6 +351,56 @@ struct zmk_hid_vendor_key_commit_report {
 
 #endif /* CONFIG_SETTINGS */
 
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE_FEATURE_REPORT)
+
+struct zmk_hid_event_trace_entry {
+    /* Index of the event type in the event type section */
+    uint8_t event_type_index;
+    /* Index of the listener subscription that handled the event */
+    uint8_t listener_index;
+    /* Value returned by the listener */
+    int8_t result;
+    /* Time spent in the listener, in hardware cycles */
+    uint32_t cycles;
+} __packed;
+
+struct zmk_hid_event_trace_report_body {
+    /* Sequence number of the first entry in this report */
+    uint32_t sequence;
+    /* Number of valid entries in this report */
+    uint8_t count;
+    struct zmk_hid_event_trace_entry entries[ZMK_HID_EVENT_TRACE_REPORT_ENTRIES];
+} __packed;
+
+struct zmk_hid_event_trace_report {
+    uint8_t report_id;
+    struct zmk_hid_event_trace_report_body body;
+} __packed;
+
+#endif /* CONFIG_ZMK_EVENT_MANAGER_TRACE_FEATURE_REPORT */
+
+#if IS_ENABLED(CONFIG_ZMK_DECISION_STATS_FEATURE_REPORT)
+
+struct zmk_hid_decision_stats_report_body {
+    /* Index of the behavior instance, in link order */
+    uint8_t index;
+    /* Index of the decision reason of the instance */
+    uint8_t reason;
+    /* Number of reasons of the instance */
+    uint8_t reason_count;
+    /* Name of the instance, NUL padded */
+    char name[ZMK_HID_DECISION_STATS_NAME_LEN];
+    /* Number of decisions in each latency bucket */
+    uint32_t buckets[ZMK_DECISION_STATS_BUCKETS];
+} __packed;
+
+struct zmk_hid_decision_stats_report {
+    uint8_t report_id;
+    struct zmk_hid_decision_stats_report_body body;
+} __packed;
+
+#endif /* CONFIG_ZMK_DECISION_STATS_FEATURE_REPORT */
+
 zmk_mod_flags_t zmk_hid_get_explicit_mods();
 int zmk_hid_register_mod(zmk_mod_t modifier);
 int zmk_hid_unregister_mod(zmk_mod_t modifier);
@@ -275,3 +430,40 @@ bool zmk_hid_is_pressed(uint32_t usage);
 struct zmk_hid_keyboard_report *zmk_hid_get_keyboard_report();
 struct zmk_hid_consumer_report *zmk_hid_get_consumer_report();
 struct zmk_hid_gen_desktop_report *zmk_hid_get_gen_desktop_report();
+
+/**
+ * @brief Check whether the report of a usage page was modified since its changes were last
+ * cleared, which the endpoints do once they have taken the report.
+ *
+ * This is cheaper than comparing the report with the last one sent. It may return true for a
+ * report whose content ended up the same, but never returns false for a report that differs.
+ */
+bool zmk_hid_report_changed(uint16_t usage_page);
+void zmk_hid_report_clear_changed(uint16_t usage_page);
+
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+void zmk_hid_mouse_buttons_press(zmk_mouse_button_flags_t buttons);
+void zmk_hid_mouse_buttons_release(zmk_mouse_button_flags_t buttons);
+void zmk_hid_mouse_movement_set(int16_t x, int16_t y);
+void zmk_hid_mouse_scroll_set(int8_t wheel, int8_t pan);
+void zmk_hid_mouse_clear();
+bool zmk_hid_mouse_report_has_motion(const struct zmk_hid_mouse_report_body *body);
+struct zmk_hid_mouse_report *zmk_hid_get_mouse_report();
+#endif /* IS_ENABLED(CONFIG_ZMK_MOUSE) */
+
+/**
+ * @brief Check whether going from the pending to the current report undoes a change that went
+ * from the sent to the pending report, e.g. a key that was pressed and released again.
+ *
+ * If it does, the pending report must reach the host before the current one, or the host would
+ * miss a press or a release. Otherwise the pending report may be replaced by the current one.
+ */
+bool zmk_hid_keyboard_report_toggles_back(const struct zmk_hid_keyboard_report_body *sent,
+                                          const struct zmk_hid_keyboard_report_body *pending,
+                                          const struct zmk_hid_keyboard_report_body *current);
+bool zmk_hid_consumer_report_toggles_back(const struct zmk_hid_consumer_report_body *sent,
+                                          const struct zmk_hid_consumer_report_body *pending,
+                                          const struct zmk_hid_consumer_report_body *current);
+bool zmk_hid_gen_desktop_report_toggles_back(const struct zmk_hid_gen_desktop_report_body *sent,
+                                             const struct zmk_hid_gen_desktop_report_body *pending,
+                                             const struct zmk_hid_gen_desktop_report_body *current);
@@ -16,7 +16,29 @@
     (DT_FOREACH_CHILD(DT_INST(0, zmk_keymap), ZMK_LAYER_CHILD_LEN_PLUS_ONE) 0)
 #endif
 
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_WIDE_LAYER_STATE)
+typedef uint64_t zmk_keymap_layers_state_t;
+#define ZMK_KEYMAP_LAYER_BIT(layer) BIT64(layer)
+#else
 typedef uint32_t zmk_keymap_layers_state_t;
+#define ZMK_KEYMAP_LAYER_BIT(layer) BIT(layer)
+#endif
+
+/**
+ * @brief Get the highest layer set in a layer state
+ * @retval The highest layer, or -1 if no layer is set.
+ */
+static inline int zmk_keymap_layers_highest(zmk_keymap_layers_state_t state) {
+    if (state == 0) {
+        return -1;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_WIDE_LAYER_STATE)
+    return 63 - __builtin_clzll(state);
+#else
+    return 31 - __builtin_clz(state);
+#endif
+}
 
 uint8_t zmk_keymap_layer_default();
 zmk_keymap_layers_state_t zmk_keymap_layer_state();
@@ -26,8 +48,24 @@ int zmk_keymap_layer_activate(uint8_t layer);
 int zmk_keymap_layer_deactivate(uint8_t layer);
 int zmk_keymap_layer_toggle(uint8_t layer);
 int zmk_keymap_layer_to(uint8_t layer);
+
+/**
+ * @brief Replace the whole layer state at once
+ *
+ * Only raises a single layer state changed event, however many layers change. The default layer
+ * stays active if it was.
+ * @param state New layer state
+ * @retval 0 If successful.
+ * @retval -EINVAL If the state has layers that don't exist in the keymap.
+ */
+int zmk_keymap_layer_state_set(zmk_keymap_layers_state_t state);
 const char *zmk_keymap_layer_label(uint8_t layer);
 
+/**
+ * @brief Notify the keymap that bindings were changed at runtime, e.g. by the settings subsystem
+ */
+void zmk_keymap_bindings_changed();
+
 int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pressed,
                                       int64_t timestamp);
 
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+typedef uint8_t zmk_mouse_button_flags_t;
+
+enum zmk_mouse_motion_type {
+    ZMK_MOUSE_MOTION_MOVE,
+    ZMK_MOUSE_MOTION_SCROLL,
+};
+
+/**
+ * Speed curve of a motion started by a key. The speed stays at zero for delay_ms, then grows
+ * from zero to the top speed over time_to_max_speed_ms, following
+ * (elapsed / time_to_max_speed_ms) ^ acceleration_exponent.
+ */
+struct zmk_mouse_motion_config {
+    enum zmk_mouse_motion_type type;
+    uint16_t delay_ms;
+    uint16_t time_to_max_speed_ms;
+    uint8_t acceleration_exponent;
+};
+
+int zmk_mouse_buttons_press(zmk_mouse_button_flags_t buttons);
+int zmk_mouse_buttons_release(zmk_mouse_button_flags_t buttons);
+
+/**
+ * @brief Add relative motion to the next mouse report
+ *
+ * May be called from any context, including interrupts, and as often as a pointing device produces
+ * samples. Motion is accumulated and sent once per tick, and no motion is ever dropped: what does
+ * not fit in one report is sent with the next one.
+ */
+void zmk_mouse_move(int32_t x, int32_t y);
+void zmk_mouse_scroll(int32_t wheel, int32_t pan);
+
+/**
+ * @brief Start a motion that lasts until it is stopped, e.g. while a mouse key is held
+ * @param id Identifies the motion when stopping it, e.g. the key position
+ * @param config Speed curve of the motion
+ * @param x Top speed along X (or of the pan when scrolling), in units per second
+ * @param y Top speed along Y (or of the wheel when scrolling), in units per second
+ * @retval 0 If successful.
+ * @retval -ENOMEM If too many motions are active.
+ */
+int zmk_mouse_motion_start(uint32_t id, const struct zmk_mouse_motion_config *config, int16_t x,
+                           int16_t y);
+void zmk_mouse_motion_stop(uint32_t id);
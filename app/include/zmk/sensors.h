@@ -22,6 +22,8 @@ const struct zmk_sensor_config *zmk_sensors_get_config_at_index(uint8_t sensor_i
 
 struct zmk_sensor_config {
     uint16_t triggers_per_rotation;
+    // Motion from the sensor moves the mouse instead of triggering the keymap bindings
+    bool pointing;
 };
 
 // This struct is also used for data transfer for splits, so any changes to the size, layout, etc
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Type a sequence of keys as fast as the host reads keyboard reports
+ *
+ * Instead of one press report and one release report per key, each report presses as many of the
+ * next keys as the host will read in the same order: distinct keys that need the same modifiers,
+ * up to the size of the report. A key that repeats, or needs other modifiers, waits for a report
+ * that releases the keys before it. Reports are sent once per poll interval of the transport.
+ *
+ * Must be called from the system work queue, like behaviors.
+ * @param keycodes Keys to type, encoded like the parameter of &kp, e.g. LS(A). Only keys of the
+ * keyboard usage page, other than the modifiers themselves, can be typed.
+ * @param len Number of keys
+ * @retval 0 If the keys were queued.
+ * @retval -EINVAL If a key cannot be typed. Nothing was queued.
+ * @retval -ENOMEM If the queue has no room for all the keys. Nothing was queued.
+ */
+int zmk_text_inject(const uint32_t *keycodes, size_t len);
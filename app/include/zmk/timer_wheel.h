@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/dlist.h>
+
+struct zmk_timer;
+
+typedef void (*zmk_timer_handler_t)(struct zmk_timer *timer);
+
+/**
+ * A timeout registered on the shared timer wheel. Deadlines are absolute times in milliseconds,
+ * in the same domain as k_uptime_get() and the timestamps of position events.
+ *
+ * Timers are started, stopped and handled on the system work queue, so a stopped timer is
+ * guaranteed not to call its handler afterwards.
+ */
+struct zmk_timer {
+    sys_dnode_t node;
+    int64_t deadline;
+    zmk_timer_handler_t handler;
+};
+
+/**
+ * @brief Statically define and initialize a timer
+ */
+#define ZMK_TIMER_DEFINE(name, timer_handler) struct zmk_timer name = {.handler = timer_handler}
+
+/**
+ * @brief Initialize a timer
+ * @param timer The timer to initialize
+ * @param handler Function called on the system work queue once the deadline has passed
+ */
+void zmk_timer_init(struct zmk_timer *timer, zmk_timer_handler_t handler);
+
+/**
+ * @brief Start a timer, or move its deadline if it is already running
+ *
+ * A deadline that has already passed makes the handler run as soon as possible.
+ * @param timer The timer to start
+ * @param deadline Time in milliseconds at which the handler should be called
+ */
+void zmk_timer_start(struct zmk_timer *timer, int64_t deadline);
+
+/**
+ * @brief Stop a timer
+ * @param timer The timer to stop
+ * @retval true If the timer was running.
+ * @retval false If the timer had already expired or was never started.
+ */
+bool zmk_timer_stop(struct zmk_timer *timer);
+
+static inline bool zmk_timer_is_running(const struct zmk_timer *timer) {
+    return sys_dnode_is_linked(&timer->node);
+}
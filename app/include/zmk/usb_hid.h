@@ -6,4 +6,31 @@
 
 #pragma once
 
-int zmk_usb_hid_send_report(const uint8_t *report, size_t len);
\ No newline at end of file
+#include <zephyr/kernel.h>
+
+// Bucket 0 counts reports read within a microsecond, bucket b counts reports read after
+// [2^(b-1), 2^b) us, and the last bucket also counts everything slower.
+#define ZMK_USB_HID_LATENCY_BUCKETS 17
+
+struct zmk_usb_hid_stats {
+    // Reports that found the endpoint busy and were queued
+    uint32_t stalls;
+    // Queued reports that were replaced by a newer report of the same type
+    uint32_t merges;
+    // Reports that were never read by the host, because the write failed or USB went away
+    uint32_t drops;
+#if IS_ENABLED(CONFIG_ZMK_USB_HID_LATENCY_STATS)
+    // Time from sending each report until the host read it from the endpoint
+    uint32_t latency_us[ZMK_USB_HID_LATENCY_BUCKETS];
+#endif
+};
+
+/**
+ * Sends an input report, whose first byte is its report ID. Never blocks: if the endpoint is still
+ * busy with an earlier report, the report is queued and written once the host has read it.
+ * @retval -EAGAIN If the queue of a mouse report is full. Mouse reports don't replace each other,
+ * since that would lose their motion.
+ */
+int zmk_usb_hid_send_report(const uint8_t *report, size_t len);
+
+struct zmk_usb_hid_stats zmk_usb_hid_get_stats();
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_sensor_mock
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(sensor_mock, CONFIG_SENSOR_LOG_LEVEL);
+
+// Cells per event: wait-ms dx dy
+#define EVENT_CELLS 3
+
+struct sensor_mock_config {
+    // Devicetree cells are unsigned, negative motion is stored as its two's complement
+    const uint32_t *events;
+    size_t events_len;
+};
+
+struct sensor_mock_data {
+    const struct device *dev;
+    struct k_work_delayable work;
+    const struct sensor_trigger *trigger;
+    sensor_trigger_handler_t handler;
+    size_t event_index;
+    int32_t dx;
+    int32_t dy;
+};
+
+static void sensor_mock_schedule_next_event(const struct device *dev) {
+    struct sensor_mock_data *data = dev->data;
+    const struct sensor_mock_config *cfg = dev->config;
+
+    if (data->event_index < cfg->events_len) {
+        k_work_schedule(&data->work, K_MSEC(cfg->events[data->event_index]));
+    }
+}
+
+static void sensor_mock_work_handler(struct k_work *work) {
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct sensor_mock_data *data = CONTAINER_OF(dwork, struct sensor_mock_data, work);
+    const struct sensor_mock_config *cfg = data->dev->config;
+
+    data->dx = (int32_t)cfg->events[data->event_index + 1];
+    data->dy = (int32_t)cfg->events[data->event_index + 2];
+    data->event_index += EVENT_CELLS;
+
+    LOG_DBG("dx %d dy %d", data->dx, data->dy);
+    data->handler(data->dev, data->trigger);
+    sensor_mock_schedule_next_event(data->dev);
+}
+
+static int sensor_mock_trigger_set(const struct device *dev, const struct sensor_trigger *trig,
+                                   sensor_trigger_handler_t handler) {
+    struct sensor_mock_data *data = dev->data;
+
+    if (handler == NULL) {
+        return -EINVAL;
+    }
+
+    data->trigger = trig;
+    data->handler = handler;
+    data->event_index = 0;
+    sensor_mock_schedule_next_event(dev);
+    return 0;
+}
+
+static int sensor_mock_sample_fetch(const struct device *dev, enum sensor_channel chan) {
+    return 0;
+}
+
+static int sensor_mock_channel_get(const struct device *dev, enum sensor_channel chan,
+                                   struct sensor_value *val) {
+    struct sensor_mock_data *data = dev->data;
+
+    switch (chan) {
+    case SENSOR_CHAN_POS_DX:
+        *val = (struct sensor_value){.val1 = data->dx};
+        return 0;
+    case SENSOR_CHAN_POS_DY:
+        *val = (struct sensor_value){.val1 = data->dy};
+        return 0;
+    default:
+        return -ENOTSUP;
+    }
+}
+
+static const struct sensor_driver_api sensor_mock_driver_api = {
+    .trigger_set = sensor_mock_trigger_set,
+    .sample_fetch = sensor_mock_sample_fetch,
+    .channel_get = sensor_mock_channel_get,
+};
+
+static int sensor_mock_init(const struct device *dev) {
+    struct sensor_mock_data *data = dev->data;
+
+    data->dev = dev;
+    k_work_init_delayable(&data->work, sensor_mock_work_handler);
+    return 0;
+}
+
+#define SENSOR_MOCK_INST(n)                                                                        \
+    BUILD_ASSERT(DT_INST_PROP_LEN(n, events) % EVENT_CELLS == 0,                                   \
+                 "events must be groups of <wait-ms dx dy>");                                      \
+    static const uint32_t sensor_mock_events_##n[] = DT_INST_PROP(n, events);                      \
+    static const struct sensor_mock_config sensor_mock_config_##n = {                              \
+        .events = sensor_mock_events_##n,                                                          \
+        .events_len = ARRAY_SIZE(sensor_mock_events_##n),                                          \
+    };                                                                                             \
+    static struct sensor_mock_data sensor_mock_data_##n;                                           \
+    DEVICE_DT_INST_DEFINE(n, sensor_mock_init, NULL, &sensor_mock_data_##n,                        \
+                          &sensor_mock_config_##n, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,       \
+                          &sensor_mock_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SENSOR_MOCK_INST)
@@ -124,8 +124,8 @@ static const struct animation_api animation_indicator_api = {
         return animation_indicator_on_key_press(dev, event);                        \
     }                                                                               \
                                                                                     \
-    ZMK_LISTENER(animation_indicator_##inst,                                        \
-                 animation_indicator_##inst##_event_handler);                       \
+    ZMK_LISTENER_DEFERRED(animation_indicator_##inst,                               \
+                          animation_indicator_##inst##_event_handler);              \
     ZMK_SUBSCRIPTION(animation_indicator_##inst, zmk_keycode_state_changed);
 
 DT_INST_FOREACH_STATUS_OKAY(ANIMATION_INDICATOR_DEVICE);
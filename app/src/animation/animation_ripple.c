@@ -207,7 +207,7 @@ static const struct animation_api animation_ripple_api = {
         return animation_ripple_on_key_press(dev, event);                                          \
     }                                                                                              \
                                                                                                    \
-    ZMK_LISTENER(animation_ripple_##idx, animation_ripple_##idx##_event_handler);                  \
+    ZMK_LISTENER_DEFERRED(animation_ripple_##idx, animation_ripple_##idx##_event_handler);         \
     ZMK_SUBSCRIPTION(animation_ripple_##idx, zmk_position_state_changed);
 
 DT_INST_FOREACH_STATUS_OKAY(ANIMATION_RIPPLE_DEVICE);
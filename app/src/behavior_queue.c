@@ -8,10 +8,16 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/slist.h>
 #include <drivers/behavior.h>
 
+#include <zmk/endpoints.h>
+#include <zmk/timer_wheel.h>
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+#define QUEUE_CHUNK_ITEMS 16
+
 struct q_item {
     uint32_t position;
     struct zmk_behavior_binding binding;
@@ -19,20 +25,120 @@ struct q_item {
     uint32_t wait : 31;
 };
 
-K_MSGQ_DEFINE(zmk_behavior_queue_msgq, sizeof(struct q_item), CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE, 4);
+// The queue is a list of chunks, so a long macro takes more chunks instead of being dropped.
+// Items are taken from the first chunk and added to the last one.
+struct q_chunk {
+    sys_snode_t node;
+    uint8_t head;
+    uint8_t tail;
+    struct q_item items[QUEUE_CHUNK_ITEMS];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(chunk_slab, sizeof(struct q_chunk),
+                         DIV_ROUND_UP(CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE, QUEUE_CHUNK_ITEMS),
+                         sizeof(void *));
+
+static sys_slist_t chunks = SYS_SLIST_STATIC_INIT(&chunks);
+
+// Time at which the first item in the queue is due. Each item's wait is added to the deadline of
+// the item before it rather than to the time it actually ran, so waits don't drift.
+static int64_t next_at;
+static bool processing;
+
+static void behavior_queue_timer_handler(struct zmk_timer *timer);
+static ZMK_TIMER_DEFINE(queue_timer, behavior_queue_timer_handler);
+
+static inline bool is_slab_chunk(const struct q_chunk *chunk) {
+    const char *p = (const char *)chunk;
+    return p >= chunk_slab.buffer &&
+           p < chunk_slab.buffer + (chunk_slab.num_blocks * chunk_slab.block_size);
+}
+
+static struct q_chunk *alloc_chunk() {
+    void *block;
+
+    if (k_mem_slab_alloc(&chunk_slab, &block, K_NO_WAIT) != 0) {
+        LOG_WRN("Behavior queue exceeds %d items, falling back to the heap",
+                CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE);
+        block = k_malloc(sizeof(struct q_chunk));
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    struct q_chunk *chunk = block;
+    chunk->head = 0;
+    chunk->tail = 0;
+    return chunk;
+}
+
+static void free_chunk(struct q_chunk *chunk) {
+    if (is_slab_chunk(chunk)) {
+        void *block = chunk;
+        k_mem_slab_free(&chunk_slab, &block);
+        return;
+    }
+
+    k_free(chunk);
+}
+
+static inline struct q_chunk *first_chunk() {
+    return SYS_SLIST_PEEK_HEAD_CONTAINER(&chunks, (struct q_chunk *)NULL, node);
+}
+
+static inline bool queue_is_empty() {
+    struct q_chunk *chunk = first_chunk();
+    return chunk == NULL || chunk->head == chunk->tail;
+}
+
+static int push_item(const struct q_item *item) {
+    struct q_chunk *chunk = SYS_SLIST_PEEK_TAIL_CONTAINER(&chunks, (struct q_chunk *)NULL, node);
 
-static void behavior_queue_process_next(struct k_work *work);
-static K_WORK_DELAYABLE_DEFINE(queue_work, behavior_queue_process_next);
+    if (chunk == NULL || chunk->tail == QUEUE_CHUNK_ITEMS) {
+        chunk = alloc_chunk();
+        if (chunk == NULL) {
+            return -ENOMEM;
+        }
+        sys_slist_append(&chunks, &chunk->node);
+    }
+
+    chunk->items[chunk->tail++] = *item;
+    return 0;
+}
+
+static void pop_item(struct q_item *item) {
+    struct q_chunk *chunk = first_chunk();
+
+    *item = chunk->items[chunk->head++];
+
+    if (chunk->head == chunk->tail) {
+        // Keep the last chunk around, so a queue that is filled and drained one item at a time
+        // doesn't allocate a chunk for each item.
+        if (chunk->tail == QUEUE_CHUNK_ITEMS || sys_slist_peek_next(&chunk->node) != NULL) {
+            sys_slist_get(&chunks);
+            free_chunk(chunk);
+        } else {
+            chunk->head = 0;
+            chunk->tail = 0;
+        }
+    }
+}
 
-static void behavior_queue_process_next(struct k_work *work) {
-    struct q_item item = {.wait = 0};
+static void behavior_queue_process(int64_t now) {
+    struct q_item item;
+
+    processing = true;
+
+    // Items without a wait run back to back in a single pass, and report to the host together.
+    zmk_endpoints_batch_begin();
+    while (!queue_is_empty() && next_at <= now) {
+        pop_item(&item);
 
-    while (k_msgq_get(&zmk_behavior_queue_msgq, &item, K_NO_WAIT) == 0) {
         LOG_DBG("Invoking %s: 0x%02x 0x%02x", item.binding.behavior_dev, item.binding.param1,
                 item.binding.param2);
 
         struct zmk_behavior_binding_event event = {.position = item.position,
-                                                   .timestamp = k_uptime_get()};
+                                                   .timestamp = next_at};
 
         if (item.press) {
             behavior_keymap_binding_pressed(&item.binding, event);
@@ -42,25 +148,45 @@ static void behavior_queue_process_next(struct k_work *work) {
 
         LOG_DBG("Processing next queued behavior in %dms", item.wait);
 
-        if (item.wait > 0) {
-            k_work_schedule(&queue_work, K_MSEC(item.wait));
-            break;
-        }
+        next_at += item.wait;
+    }
+
+    zmk_endpoints_batch_end();
+    processing = false;
+
+    if (!queue_is_empty()) {
+        zmk_timer_start(&queue_timer, next_at);
     }
 }
 
+static void behavior_queue_timer_handler(struct zmk_timer *timer) {
+    behavior_queue_process(k_uptime_get());
+}
+
 int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding binding, bool press,
                            uint32_t wait) {
-    struct q_item item = {.press = press, .binding = binding, .wait = wait};
+    struct q_item item = {.position = position, .press = press, .binding = binding, .wait = wait};
+
+    bool was_empty = queue_is_empty();
 
-    const int ret = k_msgq_put(&zmk_behavior_queue_msgq, &item, K_NO_WAIT);
+    const int ret = push_item(&item);
     if (ret < 0) {
+        LOG_ERR("Unable to queue behavior %s, out of memory", binding.behavior_dev);
         return ret;
     }
 
-    if (!k_work_delayable_is_pending(&queue_work)) {
-        behavior_queue_process_next(&queue_work.work);
+    // Items added by a behavior that is being invoked run once the queue gets to them.
+    if (processing || zmk_timer_is_running(&queue_timer)) {
+        return 0;
     }
 
+    int64_t now = k_uptime_get();
+    if (was_empty) {
+        // An idle queue starts over from now, unless the wait of the last item hasn't passed yet.
+        next_at = MAX(next_at, now);
+    }
+
+    behavior_queue_process(now);
+
     return 0;
 }
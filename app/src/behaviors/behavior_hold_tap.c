@@ -19,17 +19,23 @@
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
+#include <zmk/timer_wheel.h>
+#include <zmk/capture_buffer.h>
+#include <zmk/decision_stats.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
 #define ZMK_BHV_HOLD_TAP_MAX_HELD 10
-#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 40
 
 // increase if you have keyboard with more keys.
 #define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED 9999
 
+// Intervals between key presses are capped at this before they are averaged, so a single pause
+// brings an adaptive tapping term most of the way back to tapping-term-ms.
+#define ZMK_BHV_HOLD_TAP_CADENCE_IDLE_MS 500
+
 enum flavor {
     FLAVOR_HOLD_PREFERRED,
     FLAVOR_BALANCED,
@@ -50,31 +56,41 @@ enum decision_moment {
     HT_OTHER_KEY_UP,
     HT_TIMER_EVENT,
     HT_QUICK_TAP,
+    // The capture buffer is full, decided as if the tapping term had expired
+    HT_CAPTURE_OVERFLOW,
 };
 
 struct behavior_hold_tap_config {
     int tapping_term_ms;
-    char *hold_behavior_dev;
-    char *tap_behavior_dev;
+    int adaptive_tapping_term_min_ms;
     int quick_tap_ms;
     int require_prior_idle_ms;
     enum flavor flavor;
     bool retro_tap;
     bool hold_trigger_on_release;
+    const struct zmk_decision_stats *stats;
     int32_t hold_trigger_key_positions_len;
     int32_t hold_trigger_key_positions[];
 };
 
+struct behavior_hold_tap_data {
+    struct zmk_behavior_binding hold_binding;
+    struct zmk_behavior_binding tap_binding;
+};
+
 // this data is specific for each hold-tap
 struct active_hold_tap {
     int32_t position;
     uint32_t param_hold;
     uint32_t param_tap;
     int64_t timestamp;
+    // tapping term of this press, which is shorter than the configured one during fast typing
+    // if the adaptive tapping term is enabled
+    int32_t tapping_term_ms;
     enum status status;
     const struct behavior_hold_tap_config *config;
-    struct k_work_delayable work;
-    bool work_is_cancelled;
+    struct behavior_hold_tap_data *data;
+    struct zmk_timer timer;
 
     // initialized to -1, which is to be interpreted as "no other key has been pressed yet"
     int32_t position_of_first_other_key_pressed;
@@ -84,11 +100,21 @@ struct active_hold_tap {
 // other keypress events can be released. While the undecided_hold_tap is
 // not NULL, most events are captured in captured_events.
 // After the hold_tap is decided, it will stay in the active_hold_taps until
-// its key-up has been processed and the delayed work is cleaned up.
+// its key-up has been processed.
 struct active_hold_tap *undecided_hold_tap = NULL;
 struct active_hold_tap active_hold_taps[ZMK_BHV_HOLD_TAP_MAX_HELD] = {};
+// Bitset of the indices in active_hold_taps that are in use.
+static uint32_t active_hold_tap_mask;
+// Bitset of the active hold-taps with retro-tap that were decided by their timer, and still
+// need to be turned into a hold-interrupt once another key is pressed.
+static uint32_t retro_tap_pending_mask;
+// Index + 1 in active_hold_taps of the hold-tap at each key position, or 0 if there is none.
+// Hold-taps on virtual key positions (e.g. combos) are not indexed and are found by a scan.
+static uint8_t hold_tap_by_position[ZMK_KEYMAP_LEN];
+
+BUILD_ASSERT(ZMK_BHV_HOLD_TAP_MAX_HELD <= 32, "active_hold_tap_mask holds at most 32 hold-taps");
 // We capture most position_state_changed events and some modifiers_state_changed events.
-const zmk_event_t *captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+ZMK_CAPTURE_BUFFER_DEFINE(captured_events, CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_CAPTURED_EVENTS);
 
 // Keep track of which key was tapped most recently for the standard, if it is a hold-tap
 // a position, will be given, if not it will just be INT32_MIN
@@ -108,6 +134,38 @@ static void store_last_tapped(int64_t timestamp) {
     }
 }
 
+// Running average of the interval between key presses, of any key.
+struct typing_cadence {
+    int64_t last_press_timestamp;
+    int32_t average_interval_ms;
+};
+
+struct typing_cadence typing_cadence = {INT32_MIN, ZMK_BHV_HOLD_TAP_CADENCE_IDLE_MS};
+
+static void update_typing_cadence(int64_t timestamp) {
+    // captured events are raised again later, but only count once.
+    if (timestamp <= typing_cadence.last_press_timestamp) {
+        return;
+    }
+
+    int32_t interval =
+        MIN(timestamp - typing_cadence.last_press_timestamp, ZMK_BHV_HOLD_TAP_CADENCE_IDLE_MS);
+    typing_cadence.last_press_timestamp = timestamp;
+    // exponential moving average that weighs the latest interval by half.
+    typing_cadence.average_interval_ms = (typing_cadence.average_interval_ms + interval) / 2;
+}
+
+// During a roll, keys are released within about two intervals of being pressed, so a key that is
+// held longer than that can be decided as a hold earlier than tapping-term-ms.
+static int32_t effective_tapping_term(const struct behavior_hold_tap_config *config) {
+    if (config->adaptive_tapping_term_min_ms < 0) {
+        return config->tapping_term_ms;
+    }
+
+    return CLAMP(2 * typing_cadence.average_interval_ms, config->adaptive_tapping_term_min_ms,
+                 config->tapping_term_ms);
+}
+
 static void store_last_hold_tapped(struct active_hold_tap *hold_tap) {
     last_tapped.position = hold_tap->position;
     last_tapped.timestamp = hold_tap->timestamp;
@@ -122,94 +180,53 @@ static bool is_quick_tap(struct active_hold_tap *hold_tap) {
     }
 }
 
-static int capture_event(const zmk_event_t *event) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        if (captured_events[i] == NULL) {
-            captured_events[i] = event;
-            return 0;
-        }
-    }
-    return -ENOMEM;
-}
+const struct zmk_listener zmk_listener_behavior_hold_tap;
 
-static struct zmk_position_state_changed *find_captured_keydown_event(uint32_t position) {
-    struct zmk_position_state_changed *last_match = NULL;
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *eh = captured_events[i];
-        if (eh == NULL) {
-            return last_match;
-        }
-        struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(eh);
-        if (position_event == NULL) {
-            continue;
-        }
+static void release_captured_event(const zmk_event_t *captured_event, size_t index) {
+    if (undecided_hold_tap != NULL) {
+        k_msleep(10);
+    }
 
-        if (position_event->position == position && position_event->state) {
-            last_match = position_event;
-        }
+    struct zmk_position_state_changed *position_event;
+    struct zmk_keycode_state_changed *modifier_event;
+    if ((position_event = as_zmk_position_state_changed(captured_event)) != NULL) {
+        LOG_DBG("Releasing key position event for position %d %s", position_event->position,
+                (position_event->state ? "pressed" : "released"));
+    } else if ((modifier_event = as_zmk_keycode_state_changed(captured_event)) != NULL) {
+        LOG_DBG("Releasing mods changed event 0x%02X %s", modifier_event->keycode,
+                (modifier_event->state ? "pressed" : "released"));
     }
-    return last_match;
+    ZMK_EVENT_RAISE_AT(captured_event, behavior_hold_tap);
 }
 
-const struct zmk_listener zmk_listener_behavior_hold_tap;
-
 static void release_captured_events() {
     if (undecided_hold_tap != NULL) {
         return;
     }
 
-    // We use a trick to prevent copying the captured_events array.
-    //
-    // Events for different mod-tap instances are separated by a NULL pointer.
-    //
-    // The first event popped will never be catched by the next active hold-tap
-    // because to start capturing a mod-tap-key-down event must first completely
-    // go through the events queue.
-    //
-    // Example of this release process;
-    // [mt2_down, k1_down, k1_up, mt2_up, null, ...]
-    //  ^
-    // mt2_down position event isn't captured because no hold-tap is active.
-    // mt2_down behavior event is handled, now we have an undecided hold-tap
-    // [null, k1_down, k1_up, mt2_up, null, ...]
-    //        ^
-    // k1_down  is captured by the mt2 mod-tap
-    // !note that searches for find_captured_keydown_event by the mt2 behavior will stop at the
-    // first null encountered [mt1_down, null, k1_up, mt2_up, null, ...]
-    //                  ^
-    // k1_up event is captured by the new hold-tap:
-    // [k1_down, k1_up, null, mt2_up, null, ...]
-    //                        ^
-    // mt2_up event is not captured but causes release of mt2 behavior
-    // [k1_down, k1_up, null, null, null, ...]
-    // now mt2 will start releasing it's own captured positions.
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *captured_event = captured_events[i];
-        if (captured_event == NULL) {
-            return;
-        }
-        captured_events[i] = NULL;
-        if (undecided_hold_tap != NULL) {
-            k_msleep(10);
-        }
+    // Releasing an event can start a new undecided hold-tap, which then captures the events that
+    // follow it. Those go into a new segment of the buffer, so they are released by that hold-tap
+    // and not by this loop. For example, with [mt2_down, k1_down, k1_up, mt2_up]:
+    // mt2_down isn't captured because no hold-tap is active, and makes mt2 undecided.
+    // k1_down and k1_up are captured by mt2 into the new segment.
+    // mt2_up is not captured but decides mt2, which releases k1_down and k1_up.
+    zmk_capture_buffer_release(&captured_events, release_captured_event);
+}
 
-        struct zmk_position_state_changed *position_event;
-        struct zmk_keycode_state_changed *modifier_event;
-        if ((position_event = as_zmk_position_state_changed(captured_event)) != NULL) {
-            LOG_DBG("Releasing key position event for position %d %s", position_event->position,
-                    (position_event->state ? "pressed" : "released"));
-        } else if ((modifier_event = as_zmk_keycode_state_changed(captured_event)) != NULL) {
-            LOG_DBG("Releasing mods changed event 0x%02X %s", modifier_event->keycode,
-                    (modifier_event->state ? "pressed" : "released"));
-        }
-        ZMK_EVENT_RAISE_AT(captured_event, behavior_hold_tap);
-    }
+static inline uint32_t hold_tap_bit(const struct active_hold_tap *hold_tap) {
+    return BIT(hold_tap - active_hold_taps);
 }
 
 static struct active_hold_tap *find_hold_tap(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        if (active_hold_taps[i].position == position) {
-            return &active_hold_taps[i];
+    if (position < ZMK_KEYMAP_LEN) {
+        uint8_t index = hold_tap_by_position[position];
+        return index == 0 ? NULL : &active_hold_taps[index - 1];
+    }
+
+    for (uint32_t mask = active_hold_tap_mask; mask != 0; mask &= mask - 1) {
+        struct active_hold_tap *hold_tap = &active_hold_taps[__builtin_ctz(mask)];
+        if (hold_tap->position == position) {
+            return hold_tap;
         }
     }
     return NULL;
@@ -217,27 +234,39 @@ static struct active_hold_tap *find_hold_tap(uint32_t position) {
 
 static struct active_hold_tap *store_hold_tap(uint32_t position, uint32_t param_hold,
                                               uint32_t param_tap, int64_t timestamp,
-                                              const struct behavior_hold_tap_config *config) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        if (active_hold_taps[i].position != ZMK_BHV_HOLD_TAP_POSITION_NOT_USED) {
-            continue;
-        }
-        active_hold_taps[i].position = position;
-        active_hold_taps[i].status = STATUS_UNDECIDED;
-        active_hold_taps[i].config = config;
-        active_hold_taps[i].param_hold = param_hold;
-        active_hold_taps[i].param_tap = param_tap;
-        active_hold_taps[i].timestamp = timestamp;
-        active_hold_taps[i].position_of_first_other_key_pressed = -1;
-        return &active_hold_taps[i];
-    }
-    return NULL;
+                                              const struct behavior_hold_tap_config *config,
+                                              struct behavior_hold_tap_data *data) {
+    int i = __builtin_ctz(~active_hold_tap_mask);
+    if (i >= ZMK_BHV_HOLD_TAP_MAX_HELD) {
+        return NULL;
+    }
+
+    active_hold_tap_mask |= BIT(i);
+    if (position < ZMK_KEYMAP_LEN) {
+        hold_tap_by_position[position] = i + 1;
+    }
+
+    active_hold_taps[i].position = position;
+    active_hold_taps[i].status = STATUS_UNDECIDED;
+    active_hold_taps[i].config = config;
+    active_hold_taps[i].data = data;
+    active_hold_taps[i].param_hold = param_hold;
+    active_hold_taps[i].param_tap = param_tap;
+    active_hold_taps[i].timestamp = timestamp;
+    active_hold_taps[i].tapping_term_ms = effective_tapping_term(config);
+    active_hold_taps[i].position_of_first_other_key_pressed = -1;
+    return &active_hold_taps[i];
 }
 
 static void clear_hold_tap(struct active_hold_tap *hold_tap) {
+    active_hold_tap_mask &= ~hold_tap_bit(hold_tap);
+    retro_tap_pending_mask &= ~hold_tap_bit(hold_tap);
+    if (hold_tap->position < ZMK_KEYMAP_LEN) {
+        hold_tap_by_position[hold_tap->position] = 0;
+    }
+
     hold_tap->position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
     hold_tap->status = STATUS_UNDECIDED;
-    hold_tap->work_is_cancelled = false;
 }
 
 static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_moment event) {
@@ -249,6 +278,7 @@ static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_mome
         hold_tap->status = STATUS_HOLD_INTERRUPT;
         return;
     case HT_TIMER_EVENT:
+    case HT_CAPTURE_OVERFLOW:
         hold_tap->status = STATUS_HOLD_TIMER;
         return;
     case HT_QUICK_TAP:
@@ -265,6 +295,7 @@ static void decide_tap_preferred(struct active_hold_tap *hold_tap, enum decision
         hold_tap->status = STATUS_TAP;
         return;
     case HT_TIMER_EVENT:
+    case HT_CAPTURE_OVERFLOW:
         hold_tap->status = STATUS_HOLD_TIMER;
         return;
     case HT_QUICK_TAP:
@@ -285,6 +316,7 @@ static void decide_tap_unless_interrupted(struct active_hold_tap *hold_tap,
         hold_tap->status = STATUS_HOLD_INTERRUPT;
         return;
     case HT_TIMER_EVENT:
+    case HT_CAPTURE_OVERFLOW:
         hold_tap->status = STATUS_TAP;
         return;
     case HT_QUICK_TAP:
@@ -304,6 +336,7 @@ static void decide_hold_preferred(struct active_hold_tap *hold_tap, enum decisio
         hold_tap->status = STATUS_HOLD_INTERRUPT;
         return;
     case HT_TIMER_EVENT:
+    case HT_CAPTURE_OVERFLOW:
         hold_tap->status = STATUS_HOLD_TIMER;
         return;
     case HT_QUICK_TAP:
@@ -344,21 +377,30 @@ static inline const char *status_str(enum status status) {
     }
 }
 
+static const char *const decision_moment_names[] = {
+    [HT_KEY_UP] = "key-up",
+    [HT_OTHER_KEY_DOWN] = "other-key-down",
+    [HT_OTHER_KEY_UP] = "other-key-up",
+    [HT_TIMER_EVENT] = "timer",
+    [HT_QUICK_TAP] = "quick-tap",
+    [HT_CAPTURE_OVERFLOW] = "capture-overflow",
+};
+
 static inline const char *decision_moment_str(enum decision_moment decision_moment) {
-    switch (decision_moment) {
-    case HT_KEY_UP:
-        return "key-up";
-    case HT_OTHER_KEY_DOWN:
-        return "other-key-down";
-    case HT_OTHER_KEY_UP:
-        return "other-key-up";
-    case HT_QUICK_TAP:
-        return "quick-tap";
-    case HT_TIMER_EVENT:
-        return "timer";
-    default:
+    if (decision_moment >= ARRAY_SIZE(decision_moment_names)) {
         return "UNKNOWN STATUS";
     }
+    return decision_moment_names[decision_moment];
+}
+
+// Builds the binding for the hold or tap behavior, with the device cached in the hold-tap data
+static struct zmk_behavior_binding make_binding(struct zmk_behavior_binding *data_binding,
+                                                uint32_t param1) {
+    return (struct zmk_behavior_binding){
+        .behavior_dev = data_binding->behavior_dev,
+        .dev = behavior_binding_get_device(data_binding),
+        .param1 = param1,
+    };
 }
 
 static int press_binding(struct active_hold_tap *hold_tap) {
@@ -371,13 +413,11 @@ static int press_binding(struct active_hold_tap *hold_tap) {
         .timestamp = hold_tap->timestamp,
     };
 
-    struct zmk_behavior_binding binding = {0};
+    struct zmk_behavior_binding binding;
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
-        binding.param1 = hold_tap->param_hold;
+        binding = make_binding(&hold_tap->data->hold_binding, hold_tap->param_hold);
     } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
-        binding.param1 = hold_tap->param_tap;
+        binding = make_binding(&hold_tap->data->tap_binding, hold_tap->param_tap);
         store_last_hold_tapped(hold_tap);
     }
     return behavior_keymap_binding_pressed(&binding, event);
@@ -393,13 +433,11 @@ static int release_binding(struct active_hold_tap *hold_tap) {
         .timestamp = hold_tap->timestamp,
     };
 
-    struct zmk_behavior_binding binding = {0};
+    struct zmk_behavior_binding binding;
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
-        binding.param1 = hold_tap->param_hold;
+        binding = make_binding(&hold_tap->data->hold_binding, hold_tap->param_hold);
     } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
-        binding.param1 = hold_tap->param_tap;
+        binding = make_binding(&hold_tap->data->tap_binding, hold_tap->param_tap);
     }
     return behavior_keymap_binding_released(&binding, event);
 }
@@ -470,11 +508,17 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
 
     decide_positional_hold(hold_tap);
 
+    if (hold_tap->status == STATUS_HOLD_TIMER && hold_tap->config->retro_tap) {
+        retro_tap_pending_mask |= hold_tap_bit(hold_tap);
+    }
+
     // Since the hold-tap has been decided, clean up undecided_hold_tap and
     // execute the decided behavior.
     LOG_DBG("%d decided %s (%s decision moment %s)", hold_tap->position,
             status_str(hold_tap->status), flavor_str(hold_tap->config->flavor),
             decision_moment_str(decision_moment));
+    zmk_decision_stats_record(hold_tap->config->stats, decision_moment,
+                              k_uptime_get() - hold_tap->timestamp);
     undecided_hold_tap = NULL;
     press_binding(hold_tap);
     release_captured_events();
@@ -487,6 +531,7 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
     if (hold_tap->status == STATUS_HOLD_TIMER) {
         release_binding(hold_tap);
         LOG_DBG("%d retro tap", hold_tap->position);
+        retro_tap_pending_mask &= ~hold_tap_bit(hold_tap);
         hold_tap->status = STATUS_TAP;
         press_binding(hold_tap);
         return;
@@ -494,24 +539,24 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
 }
 
 static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        struct active_hold_tap *hold_tap = &active_hold_taps[i];
+    // Only hold-taps in retro_tap_pending_mask can change here, which usually means none.
+    for (uint32_t mask = retro_tap_pending_mask; mask != 0; mask &= mask - 1) {
+        struct active_hold_tap *hold_tap = &active_hold_taps[__builtin_ctz(mask)];
+        // pressing a binding raises events, which may already have updated this hold-tap.
         if (hold_tap->position == ignore_position ||
-            hold_tap->position == ZMK_BHV_HOLD_TAP_POSITION_NOT_USED ||
-            hold_tap->config->retro_tap == false) {
+            (retro_tap_pending_mask & hold_tap_bit(hold_tap)) == 0) {
             continue;
         }
-        if (hold_tap->status == STATUS_HOLD_TIMER) {
-            LOG_DBG("Update hold tap %d status to hold-interrupt", hold_tap->position);
-            hold_tap->status = STATUS_HOLD_INTERRUPT;
-            press_binding(hold_tap);
-        }
+        LOG_DBG("Update hold tap %d status to hold-interrupt", hold_tap->position);
+        retro_tap_pending_mask &= ~hold_tap_bit(hold_tap);
+        hold_tap->status = STATUS_HOLD_INTERRUPT;
+        press_binding(hold_tap);
     }
 }
 
 static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
                                        struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
     const struct behavior_hold_tap_config *cfg = dev->config;
 
     if (undecided_hold_tap != NULL) {
@@ -521,7 +566,8 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
     }
 
     struct active_hold_tap *hold_tap =
-        store_hold_tap(event.position, binding->param1, binding->param2, event.timestamp, cfg);
+        store_hold_tap(event.position, binding->param1, binding->param2, event.timestamp, cfg,
+                       dev->data);
     if (hold_tap == NULL) {
         LOG_ERR("unable to store hold-tap info, did you press more than %d hold-taps?",
                 ZMK_BHV_HOLD_TAP_MAX_HELD);
@@ -529,16 +575,18 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
     }
 
     LOG_DBG("%d new undecided hold_tap", event.position);
+    if (cfg->adaptive_tapping_term_min_ms >= 0) {
+        LOG_DBG("%d adaptive tapping term %dms", event.position, hold_tap->tapping_term_ms);
+    }
     undecided_hold_tap = hold_tap;
 
     if (is_quick_tap(hold_tap)) {
         decide_hold_tap(hold_tap, HT_QUICK_TAP);
     }
 
-    // if this behavior was queued we have to adjust the timer to only
-    // wait for the remaining time.
-    int32_t tapping_term_ms_left = (hold_tap->timestamp + cfg->tapping_term_ms) - k_uptime_get();
-    k_work_schedule(&hold_tap->work, K_MSEC(tapping_term_ms_left));
+    // the deadline is relative to the key press, so if this behavior was queued the timer
+    // only waits for the remaining time.
+    zmk_timer_start(&hold_tap->timer, hold_tap->timestamp + hold_tap->tapping_term_ms);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -553,8 +601,8 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
 
     // If these events were queued, the timer event may be queued too late or not at all.
     // We insert a timer event before the TH_KEY_UP event to verify.
-    int work_cancel_result = k_work_cancel_delayable(&hold_tap->work);
-    if (event.timestamp > (hold_tap->timestamp + hold_tap->config->tapping_term_ms)) {
+    zmk_timer_stop(&hold_tap->timer);
+    if (event.timestamp > (hold_tap->timestamp + hold_tap->tapping_term_ms)) {
         decide_hold_tap(hold_tap, HT_TIMER_EVENT);
     }
 
@@ -562,15 +610,8 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
     decide_retro_tap(hold_tap);
     release_binding(hold_tap);
 
-    if (work_cancel_result == -EINPROGRESS) {
-        // let the timer handler clean up
-        // if we'd clear now, the timer may call back for an uninitialized active_hold_tap.
-        LOG_DBG("%d hold-tap timer work in event queue", event.position);
-        hold_tap->work_is_cancelled = true;
-    } else {
-        LOG_DBG("%d cleaning up hold-tap", event.position);
-        clear_hold_tap(hold_tap);
-    }
+    LOG_DBG("%d cleaning up hold-tap", event.position);
+    clear_hold_tap(hold_tap);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -583,6 +624,10 @@ static const struct behavior_driver_api behavior_hold_tap_driver_api = {
 static int position_state_changed_listener(const zmk_event_t *eh) {
     struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
 
+    if (ev->state) {
+        update_typing_cadence(ev->timestamp);
+    }
+
     update_hold_status_for_retro_tap(ev->position);
 
     if (undecided_hold_tap == NULL) {
@@ -614,7 +659,7 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
     // We make a timer decision before the other key events are handled if the timer would
     // have run out.
     if (ev->timestamp >
-        (undecided_hold_tap->timestamp + undecided_hold_tap->config->tapping_term_ms)) {
+        (undecided_hold_tap->timestamp + undecided_hold_tap->tapping_term_ms)) {
         decide_hold_tap(undecided_hold_tap, HT_TIMER_EVENT);
     }
 
@@ -622,7 +667,7 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
         return ZMK_EV_EVENT_BUBBLE;
     }
 
-    if (!ev->state && find_captured_keydown_event(ev->position) == NULL) {
+    if (!ev->state && !zmk_capture_buffer_has_keydown(&captured_events, ev->position)) {
         // no keydown event has been captured, let it bubble.
         // we'll catch modifiers later in modifier_state_changed_listener
         LOG_DBG("%d bubbling %d %s event", undecided_hold_tap->position, ev->position,
@@ -630,9 +675,15 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
         return ZMK_EV_EVENT_BUBBLE;
     }
 
+    if (zmk_capture_buffer_push(&captured_events, eh) < 0) {
+        // Decide now so the captured events are released ahead of this one. Releasing them may
+        // start a new undecided hold-tap, so handle this event again to capture it behind them.
+        decide_hold_tap(undecided_hold_tap, HT_CAPTURE_OVERFLOW);
+        return position_state_changed_listener(eh);
+    }
+
     LOG_DBG("%d capturing %d %s event", undecided_hold_tap->position, ev->position,
             ev->state ? "down" : "up");
-    capture_event(eh);
     decide_hold_tap(undecided_hold_tap, ev->state ? HT_OTHER_KEY_DOWN : HT_OTHER_KEY_UP);
     return ZMK_EV_EVENT_CAPTURED;
 }
@@ -657,9 +708,13 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
 
     // only key-up events will bubble through position_state_changed_listener
     // if a undecided_hold_tap is active.
+    if (zmk_capture_buffer_push(&captured_events, eh) < 0) {
+        decide_hold_tap(undecided_hold_tap, HT_CAPTURE_OVERFLOW);
+        return keycode_state_changed_listener(eh);
+    }
+
     LOG_DBG("%d capturing 0x%02X %s event", undecided_hold_tap->position, ev->keycode,
             ev->state ? "down" : "up");
-    capture_event(eh);
     return ZMK_EV_EVENT_CAPTURED;
 }
 
@@ -677,22 +732,22 @@ ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_position_state_changed);
 // this should be modifiers_state_changed, but unfrotunately that's not implemented yet.
 ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_keycode_state_changed);
 
-void behavior_hold_tap_timer_work_handler(struct k_work *item) {
-    struct active_hold_tap *hold_tap = CONTAINER_OF(item, struct active_hold_tap, work);
+void behavior_hold_tap_timer_handler(struct zmk_timer *timer) {
+    struct active_hold_tap *hold_tap = CONTAINER_OF(timer, struct active_hold_tap, timer);
 
-    if (hold_tap->work_is_cancelled) {
-        clear_hold_tap(hold_tap);
-    } else {
-        decide_hold_tap(hold_tap, HT_TIMER_EVENT);
-    }
+    decide_hold_tap(hold_tap, HT_TIMER_EVENT);
 }
 
 static int behavior_hold_tap_init(const struct device *dev) {
     static bool init_first_run = true;
+    struct behavior_hold_tap_data *data = dev->data;
+
+    behavior_binding_get_device(&data->hold_binding);
+    behavior_binding_get_device(&data->tap_binding);
 
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-            k_work_init_delayable(&active_hold_taps[i].work, behavior_hold_tap_timer_work_handler);
+            zmk_timer_init(&active_hold_taps[i].timer, behavior_hold_tap_timer_handler);
             active_hold_taps[i].position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
         }
     }
@@ -701,10 +756,15 @@ static int behavior_hold_tap_init(const struct device *dev) {
 }
 
 #define KP_INST(n)                                                                                 \
+    ZMK_DECISION_STATS_DEFINE(behavior_hold_tap_stats_##n, DT_NODE_FULL_NAME(DT_DRV_INST(n)),      \
+                              decision_moment_names);                                              \
+    static struct behavior_hold_tap_data behavior_hold_tap_data_##n = {                            \
+        .hold_binding = {.behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 0), label)},  \
+        .tap_binding = {.behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 1), label)},   \
+    };                                                                                             \
     static struct behavior_hold_tap_config behavior_hold_tap_config_##n = {                        \
         .tapping_term_ms = DT_INST_PROP(n, tapping_term_ms),                                       \
-        .hold_behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 0), label),               \
-        .tap_behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 1), label),                \
+        .adaptive_tapping_term_min_ms = DT_INST_PROP(n, adaptive_tapping_term_min_ms),             \
         .quick_tap_ms = DT_INST_PROP(n, quick_tap_ms),                                             \
         .require_prior_idle_ms = DT_INST_PROP(n, global_quick_tap)                                 \
                                      ? DT_INST_PROP(n, quick_tap_ms)                               \
@@ -712,12 +772,13 @@ static int behavior_hold_tap_init(const struct device *dev) {
         .flavor = DT_ENUM_IDX(DT_DRV_INST(n), flavor),                                             \
         .retro_tap = DT_INST_PROP(n, retro_tap),                                                   \
         .hold_trigger_on_release = DT_INST_PROP(n, hold_trigger_on_release),                       \
+        .stats = ZMK_DECISION_STATS_REF(behavior_hold_tap_stats_##n),                              \
         .hold_trigger_key_positions = DT_INST_PROP(n, hold_trigger_key_positions),                 \
         .hold_trigger_key_positions_len = DT_INST_PROP_LEN(n, hold_trigger_key_positions),         \
     };                                                                                             \
-    DEVICE_DT_INST_DEFINE(n, behavior_hold_tap_init, NULL, NULL, &behavior_hold_tap_config_##n,    \
-                          APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                        \
-                          &behavior_hold_tap_driver_api);
+    DEVICE_DT_INST_DEFINE(n, behavior_hold_tap_init, NULL, &behavior_hold_tap_data_##n,            \
+                          &behavior_hold_tap_config_##n, APPLICATION,                              \
+                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_hold_tap_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
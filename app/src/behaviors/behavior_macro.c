@@ -7,6 +7,7 @@
 #include <zephyr/device.h>
 #include <drivers/behavior.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <zmk/behavior.h>
 #include <zmk/behavior_queue.h>
 #include <zmk/keymap.h>
@@ -21,11 +22,39 @@ enum behavior_macro_mode {
 
 enum param_source { PARAM_SOURCE_BINDING, PARAM_SOURCE_MACRO_1ST, PARAM_SOURCE_MACRO_2ND };
 
+// Control bindings are compiled to their own opcode, any other binding to MACRO_OP_INVOKE.
+enum behavior_macro_op {
+    MACRO_OP_TAP_MODE,
+    MACRO_OP_PRESS_MODE,
+    MACRO_OP_RELEASE_MODE,
+    MACRO_OP_TAP_TIME,
+    MACRO_OP_WAIT_TIME,
+    MACRO_OP_PAUSE_FOR_RELEASE,
+    MACRO_OP_PARAM_1TO1,
+    MACRO_OP_PARAM_1TO2,
+    MACRO_OP_PARAM_2TO1,
+    MACRO_OP_PARAM_2TO2,
+    MACRO_OP_INVOKE,
+};
+
+// Each binding is compiled to an opcode byte, followed by a little endian uint32_t for each of
+// the parameter cells of the binding. The number of cells is kept in the top bits of the opcode
+// byte, so every instruction can be decoded without knowing what it does.
+#define MACRO_OP_PARAMS_SHIFT 6
+#define MACRO_OP_MASK BIT_MASK(MACRO_OP_PARAMS_SHIFT)
+
+struct behavior_macro_instruction {
+    enum behavior_macro_op op;
+    uint32_t param1;
+    uint32_t param2;
+};
+
 struct behavior_macro_trigger_state {
     uint32_t wait_ms;
     uint32_t tap_ms;
     enum behavior_macro_mode mode;
     uint16_t start_index;
+    uint16_t start_offset;
     uint16_t count;
     enum param_source param1_source;
     enum param_source param2_source;
@@ -41,66 +70,64 @@ struct behavior_macro_config {
     uint32_t default_wait_ms;
     uint32_t default_tap_ms;
     uint32_t count;
-    struct zmk_behavior_binding bindings[];
+    const uint8_t *bytecode;
+    // Label of the behavior of each binding, only used for MACRO_OP_INVOKE
+    const char *const *labels;
+    // Device of each invoked behavior, looked up the first time the binding is invoked
+    const struct device **devices;
 };
 
-#define TAP_MODE DT_PROP(DT_INST(0, zmk_macro_control_mode_tap), label)
-#define PRESS_MODE DT_PROP(DT_INST(0, zmk_macro_control_mode_press), label)
-#define REL_MODE DT_PROP(DT_INST(0, zmk_macro_control_mode_release), label)
+static const uint8_t *decode_instruction(const uint8_t *pc,
+                                         struct behavior_macro_instruction *ins) {
+    const uint8_t params = *pc >> MACRO_OP_PARAMS_SHIFT;
 
-#define TAP_TIME DT_PROP(DT_INST(0, zmk_macro_control_tap_time), label)
-#define WAIT_TIME DT_PROP(DT_INST(0, zmk_macro_control_wait_time), label)
-#define WAIT_REL DT_PROP(DT_INST(0, zmk_macro_pause_for_release), label)
+    ins->op = *pc++ & MACRO_OP_MASK;
+    ins->param1 = params > 0 ? sys_get_le32(pc) : 0;
+    ins->param2 = params > 1 ? sys_get_le32(pc + sizeof(uint32_t)) : 0;
 
-#define P1TO1 DT_PROP(DT_INST(0, zmk_macro_param_1to1), label)
-#define P1TO2 DT_PROP(DT_INST(0, zmk_macro_param_1to2), label)
-#define P2TO1 DT_PROP(DT_INST(0, zmk_macro_param_2to1), label)
-#define P2TO2 DT_PROP(DT_INST(0, zmk_macro_param_2to2), label)
-
-#define ZM_IS_NODE_MATCH(a, b) (strcmp(a, b) == 0)
-#define IS_TAP_MODE(dev) ZM_IS_NODE_MATCH(dev, TAP_MODE)
-#define IS_PRESS_MODE(dev) ZM_IS_NODE_MATCH(dev, PRESS_MODE)
-#define IS_RELEASE_MODE(dev) ZM_IS_NODE_MATCH(dev, REL_MODE)
-
-#define IS_TAP_TIME(dev) ZM_IS_NODE_MATCH(dev, TAP_TIME)
-#define IS_WAIT_TIME(dev) ZM_IS_NODE_MATCH(dev, WAIT_TIME)
-#define IS_PAUSE(dev) ZM_IS_NODE_MATCH(dev, WAIT_REL)
-
-#define IS_P1TO1(dev) ZM_IS_NODE_MATCH(dev, P1TO1)
-#define IS_P1TO2(dev) ZM_IS_NODE_MATCH(dev, P1TO2)
-#define IS_P2TO1(dev) ZM_IS_NODE_MATCH(dev, P2TO1)
-#define IS_P2TO2(dev) ZM_IS_NODE_MATCH(dev, P2TO2)
+    return pc + params * sizeof(uint32_t);
+}
 
 static bool handle_control_binding(struct behavior_macro_trigger_state *state,
-                                   const struct zmk_behavior_binding *binding) {
-    if (IS_TAP_MODE(binding->behavior_dev)) {
+                                   const struct behavior_macro_instruction *ins) {
+    switch (ins->op) {
+    case MACRO_OP_TAP_MODE:
         state->mode = MACRO_MODE_TAP;
         LOG_DBG("macro mode set: tap");
-    } else if (IS_PRESS_MODE(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_PRESS_MODE:
         state->mode = MACRO_MODE_PRESS;
         LOG_DBG("macro mode set: press");
-    } else if (IS_RELEASE_MODE(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_RELEASE_MODE:
         state->mode = MACRO_MODE_RELEASE;
         LOG_DBG("macro mode set: release");
-    } else if (IS_TAP_TIME(binding->behavior_dev)) {
-        state->tap_ms = binding->param1;
+        break;
+    case MACRO_OP_TAP_TIME:
+        state->tap_ms = ins->param1;
         LOG_DBG("macro tap time set: %d", state->tap_ms);
-    } else if (IS_WAIT_TIME(binding->behavior_dev)) {
-        state->wait_ms = binding->param1;
+        break;
+    case MACRO_OP_WAIT_TIME:
+        state->wait_ms = ins->param1;
         LOG_DBG("macro wait time set: %d", state->wait_ms);
-    } else if (IS_P1TO1(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_PARAM_1TO1:
         state->param1_source = PARAM_SOURCE_MACRO_1ST;
         LOG_DBG("macro param: 1to1");
-    } else if (IS_P1TO2(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_PARAM_1TO2:
         state->param2_source = PARAM_SOURCE_MACRO_1ST;
         LOG_DBG("macro param: 1to2");
-    } else if (IS_P2TO1(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_PARAM_2TO1:
         state->param1_source = PARAM_SOURCE_MACRO_2ND;
         LOG_DBG("macro param: 2to1");
-    } else if (IS_P2TO2(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_PARAM_2TO2:
         state->param2_source = PARAM_SOURCE_MACRO_2ND;
         LOG_DBG("macro param: 2to2");
-    } else {
+        break;
+    default:
         return false;
     }
 
@@ -115,11 +142,16 @@ static int behavior_macro_init(const struct device *dev) {
     state->release_state.count = 0;
 
     LOG_DBG("Precalculate initial release state:");
+    const uint8_t *pc = cfg->bytecode;
     for (int i = 0; i < cfg->count; i++) {
-        if (handle_control_binding(&state->release_state, &cfg->bindings[i])) {
+        struct behavior_macro_instruction ins;
+        pc = decode_instruction(pc, &ins);
+
+        if (handle_control_binding(&state->release_state, &ins)) {
             // Updated state used for initial state on release.
-        } else if (IS_PAUSE(cfg->bindings[i].behavior_dev)) {
+        } else if (ins.op == MACRO_OP_PAUSE_FOR_RELEASE) {
             state->release_state.start_index = i + 1;
+            state->release_state.start_offset = pc - cfg->bytecode;
             state->release_state.count = cfg->count - state->release_state.start_index;
             state->press_bindings_count = i;
             LOG_DBG("Release will resume at %d", state->release_state.start_index);
@@ -154,37 +186,48 @@ static void replace_params(struct behavior_macro_trigger_state *state,
     state->param2_source = PARAM_SOURCE_BINDING;
 }
 
-static void queue_macro(uint32_t position, const struct zmk_behavior_binding bindings[],
+static void queue_macro(uint32_t position, const struct behavior_macro_config *cfg,
                         struct behavior_macro_trigger_state state,
                         const struct zmk_behavior_binding *macro_binding) {
     LOG_DBG("Iterating macro bindings - starting: %d, count: %d", state.start_index, state.count);
+    const uint8_t *pc = &cfg->bytecode[state.start_offset];
     for (int i = state.start_index; i < state.start_index + state.count; i++) {
-        if (!handle_control_binding(&state, &bindings[i])) {
-            struct zmk_behavior_binding binding = bindings[i];
-            replace_params(&state, &binding, macro_binding);
-
-            switch (state.mode) {
-            case MACRO_MODE_TAP:
-                zmk_behavior_queue_add(position, binding, true, state.tap_ms);
-                zmk_behavior_queue_add(position, binding, false, state.wait_ms);
-                break;
-            case MACRO_MODE_PRESS:
-                zmk_behavior_queue_add(position, binding, true, state.wait_ms);
-                break;
-            case MACRO_MODE_RELEASE:
-                zmk_behavior_queue_add(position, binding, false, state.wait_ms);
-                break;
-            default:
-                LOG_ERR("Unknown macro mode: %d", state.mode);
-                break;
-            }
+        struct behavior_macro_instruction ins;
+        pc = decode_instruction(pc, &ins);
+
+        if (handle_control_binding(&state, &ins) || ins.op != MACRO_OP_INVOKE) {
+            continue;
+        }
+
+        struct zmk_behavior_binding binding = {.behavior_dev = cfg->labels[i],
+                                               .dev = cfg->devices[i],
+                                               .param1 = ins.param1,
+                                               .param2 = ins.param2};
+        // Resolved once per binding, so the queued copies carry the device
+        cfg->devices[i] = behavior_binding_get_device(&binding);
+        replace_params(&state, &binding, macro_binding);
+
+        switch (state.mode) {
+        case MACRO_MODE_TAP:
+            zmk_behavior_queue_add(position, binding, true, state.tap_ms);
+            zmk_behavior_queue_add(position, binding, false, state.wait_ms);
+            break;
+        case MACRO_MODE_PRESS:
+            zmk_behavior_queue_add(position, binding, true, state.wait_ms);
+            break;
+        case MACRO_MODE_RELEASE:
+            zmk_behavior_queue_add(position, binding, false, state.wait_ms);
+            break;
+        default:
+            LOG_ERR("Unknown macro mode: %d", state.mode);
+            break;
         }
     }
 }
 
 static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                     struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
     struct behavior_macro_trigger_state trigger_state = {.mode = MACRO_MODE_TAP,
@@ -193,18 +236,18 @@ static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                                          .start_index = 0,
                                                          .count = state->press_bindings_count};
 
-    queue_macro(event.position, cfg->bindings, trigger_state, binding);
+    queue_macro(event.position, cfg, trigger_state, binding);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
 
 static int on_macro_binding_released(struct zmk_behavior_binding *binding,
                                      struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
 
-    queue_macro(event.position, cfg->bindings, state->release_state, binding);
+    queue_macro(event.position, cfg, state->release_state, binding);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -214,16 +257,55 @@ static const struct behavior_driver_api behavior_macro_driver_api = {
     .binding_released = on_macro_binding_released,
 };
 
-#define TRANSFORMED_BEHAVIORS(n)                                                                   \
-    {LISTIFY(DT_PROP_LEN(n, bindings), ZMK_KEYMAP_EXTRACT_BINDING, (, ), n)},
+// Ternaries that select the opcode of a control binding, followed by the opcode of any other
+// binding. Every operand is a constant, so the opcode is computed by the compiler.
+#define MACRO_CONTROL_OP(node, compat, op) DT_NODE_HAS_COMPAT(node, compat) ? op :
+
+#define MACRO_OPCODE(node)                                                                         \
+    (MACRO_CONTROL_OP(node, zmk_macro_control_mode_tap, MACRO_OP_TAP_MODE)                         \
+     MACRO_CONTROL_OP(node, zmk_macro_control_mode_press, MACRO_OP_PRESS_MODE)                     \
+     MACRO_CONTROL_OP(node, zmk_macro_control_mode_release, MACRO_OP_RELEASE_MODE)                 \
+     MACRO_CONTROL_OP(node, zmk_macro_control_tap_time, MACRO_OP_TAP_TIME)                         \
+     MACRO_CONTROL_OP(node, zmk_macro_control_wait_time, MACRO_OP_WAIT_TIME)                       \
+     MACRO_CONTROL_OP(node, zmk_macro_pause_for_release, MACRO_OP_PAUSE_FOR_RELEASE)               \
+     MACRO_CONTROL_OP(node, zmk_macro_param_1to1, MACRO_OP_PARAM_1TO1)                             \
+     MACRO_CONTROL_OP(node, zmk_macro_param_1to2, MACRO_OP_PARAM_1TO2)                             \
+     MACRO_CONTROL_OP(node, zmk_macro_param_2to1, MACRO_OP_PARAM_2TO1)                             \
+     MACRO_CONTROL_OP(node, zmk_macro_param_2to2, MACRO_OP_PARAM_2TO2) MACRO_OP_INVOKE)
+
+#define MACRO_HAS_PARAM(idx, n, cell) DT_PHA_HAS_CELL_AT_IDX(n, bindings, idx, cell)
+
+#define MACRO_PARAM_BYTE(value, shift) (((uint32_t)(value) >> (shift)) & 0xFF)
+
+#define MACRO_PARAM_BYTES(idx, n, cell)                                                            \
+    COND_CODE_0(MACRO_HAS_PARAM(idx, n, cell), (),                                                 \
+                (, MACRO_PARAM_BYTE(DT_PHA_BY_IDX(n, bindings, idx, cell), 0),                     \
+                 MACRO_PARAM_BYTE(DT_PHA_BY_IDX(n, bindings, idx, cell), 8),                       \
+                 MACRO_PARAM_BYTE(DT_PHA_BY_IDX(n, bindings, idx, cell), 16),                      \
+                 MACRO_PARAM_BYTE(DT_PHA_BY_IDX(n, bindings, idx, cell), 24)))
+
+#define MACRO_INSTRUCTION(idx, n)                                                                  \
+    ((MACRO_HAS_PARAM(idx, n, param1) + MACRO_HAS_PARAM(idx, n, param2))                           \
+         << MACRO_OP_PARAMS_SHIFT |                                                                \
+     MACRO_OPCODE(DT_PHANDLE_BY_IDX(n, bindings, idx)))                                            \
+    MACRO_PARAM_BYTES(idx, n, param1) MACRO_PARAM_BYTES(idx, n, param2)
+
+#define MACRO_LABEL(idx, n) DT_PROP(DT_PHANDLE_BY_IDX(n, bindings, idx), label)
 
 #define MACRO_INST(inst)                                                                           \
+    static const uint8_t behavior_macro_bytecode_##inst[] = {                                      \
+        LISTIFY(DT_PROP_LEN(inst, bindings), MACRO_INSTRUCTION, (, ), inst)};                      \
+    static const char *const behavior_macro_labels_##inst[] = {                                    \
+        LISTIFY(DT_PROP_LEN(inst, bindings), MACRO_LABEL, (, ), inst)};                            \
+    static const struct device *behavior_macro_devices_##inst[DT_PROP_LEN(inst, bindings)];        \
     static struct behavior_macro_state behavior_macro_state_##inst = {};                           \
-    static struct behavior_macro_config behavior_macro_config_##inst = {                           \
+    static const struct behavior_macro_config behavior_macro_config_##inst = {                     \
         .default_wait_ms = DT_PROP_OR(inst, wait_ms, CONFIG_ZMK_MACRO_DEFAULT_WAIT_MS),            \
         .default_tap_ms = DT_PROP_OR(inst, tap_ms, CONFIG_ZMK_MACRO_DEFAULT_TAP_MS),               \
         .count = DT_PROP_LEN(inst, bindings),                                                      \
-        .bindings = TRANSFORMED_BEHAVIORS(inst)};                                                  \
+        .bytecode = behavior_macro_bytecode_##inst,                                                \
+        .labels = behavior_macro_labels_##inst,                                                    \
+        .devices = behavior_macro_devices_##inst};                                                 \
     DEVICE_DT_DEFINE(inst, behavior_macro_init, NULL, &behavior_macro_state_##inst,                \
                      &behavior_macro_config_##inst, APPLICATION,                                   \
                      CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_macro_driver_api);
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/device.h>
+#include <drivers/behavior.h>
+#include <zephyr/logging/log.h>
+
+#include <zmk/behavior.h>
+#include <zmk/mouse.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+static int behavior_mouse_move_init(const struct device *dev) { return 0; };
+
+static int on_keymap_binding_pressed(struct zmk_behavior_binding *binding,
+                                     struct zmk_behavior_binding_event event) {
+    const struct device *dev = behavior_binding_get_device(binding);
+    const struct zmk_mouse_motion_config *config = dev->config;
+    // Both speeds are signed 16 bit values, see MOVE() in dt-bindings/zmk/mouse.h
+    int16_t x = (int16_t)(binding->param1 & 0xFFFF);
+    int16_t y = (int16_t)(binding->param1 >> 16);
+
+    LOG_DBG("position %d x %d y %d", event.position, x, y);
+    zmk_mouse_motion_start(event.position, config, x, y);
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static int on_keymap_binding_released(struct zmk_behavior_binding *binding,
+                                      struct zmk_behavior_binding_event event) {
+    LOG_DBG("position %d", event.position);
+    zmk_mouse_motion_stop(event.position);
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static const struct behavior_driver_api behavior_mouse_move_driver_api = {
+    .binding_pressed = on_keymap_binding_pressed, .binding_released = on_keymap_binding_released};
+
+#define MOUSE_MOVE_INST(inst, motion_type)                                                         \
+    BUILD_ASSERT(DT_PROP(inst, acceleration_exponent) <= 2,                                        \
+                 "acceleration-exponent must be 0, 1 or 2");                                       \
+    static const struct zmk_mouse_motion_config behavior_mouse_move_config_##inst = {              \
+        .type = motion_type,                                                                       \
+        .delay_ms = DT_PROP(inst, delay_ms),                                                       \
+        .time_to_max_speed_ms = DT_PROP(inst, time_to_max_speed_ms),                               \
+        .acceleration_exponent = DT_PROP(inst, acceleration_exponent),                             \
+    };                                                                                             \
+    DEVICE_DT_DEFINE(inst, behavior_mouse_move_init, NULL, NULL,                                   \
+                     &behavior_mouse_move_config_##inst, APPLICATION,                              \
+                     CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_mouse_move_driver_api);
+
+DT_FOREACH_STATUS_OKAY_VARGS(zmk_behavior_mouse_move, MOUSE_MOVE_INST, ZMK_MOUSE_MOTION_MOVE)
+DT_FOREACH_STATUS_OKAY_VARGS(zmk_behavior_mouse_scroll, MOUSE_MOVE_INST, ZMK_MOUSE_MOTION_SCROLL)
@@ -16,7 +16,9 @@ static const struct behavior_driver_api behavior_sensor_rotate_driver_api = {
     .sensor_binding_accept_data = zmk_behavior_sensor_rotate_common_accept_data,
     .sensor_binding_process = zmk_behavior_sensor_rotate_common_process};
 
-static int behavior_sensor_rotate_init(const struct device *dev) { return 0; };
+static int behavior_sensor_rotate_init(const struct device *dev) {
+    return zmk_behavior_sensor_rotate_common_init(dev);
+};
 
 #define _TRANSFORM_ENTRY(idx, node)                                                                \
     {                                                                                              \
@@ -29,12 +31,13 @@ static int behavior_sensor_rotate_init(const struct device *dev) { return 0; };
 
 #define SENSOR_ROTATE_INST(n)                                                                      \
     static struct behavior_sensor_rotate_config behavior_sensor_rotate_config_##n = {              \
-        .cw_binding = _TRANSFORM_ENTRY(0, n),                                                      \
-        .ccw_binding = _TRANSFORM_ENTRY(1, n),                                                     \
         .tap_ms = DT_INST_PROP_OR(n, tap_ms, 5),                                                   \
         .override_params = false,                                                                  \
     };                                                                                             \
-    static struct behavior_sensor_rotate_data behavior_sensor_rotate_data_##n = {};                \
+    static struct behavior_sensor_rotate_data behavior_sensor_rotate_data_##n = {                  \
+        .cw_binding = _TRANSFORM_ENTRY(0, n),                                                      \
+        .ccw_binding = _TRANSFORM_ENTRY(1, n),                                                     \
+    };                                                                                             \
     DEVICE_DT_INST_DEFINE(n, behavior_sensor_rotate_init, NULL, &behavior_sensor_rotate_data_##n,  \
                           &behavior_sensor_rotate_config_##n, APPLICATION,                         \
                           CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                                     \
@@ -11,11 +11,19 @@
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+int zmk_behavior_sensor_rotate_common_init(const struct device *dev) {
+    struct behavior_sensor_rotate_data *data = dev->data;
+
+    behavior_binding_get_device(&data->cw_binding);
+    behavior_binding_get_device(&data->ccw_binding);
+    return 0;
+}
+
 int zmk_behavior_sensor_rotate_common_accept_data(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event,
     const struct zmk_sensor_config *sensor_config, size_t channel_data_size,
     const struct zmk_sensor_channel_data *channel_data) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
     struct behavior_sensor_rotate_data *data = dev->data;
 
     const struct sensor_value value = channel_data[0].value;
@@ -58,7 +66,7 @@ int zmk_behavior_sensor_rotate_common_accept_data(
 int zmk_behavior_sensor_rotate_common_process(struct zmk_behavior_binding *binding,
                                               struct zmk_behavior_binding_event event,
                                               enum behavior_sensor_binding_process_mode mode) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_binding_get_device(binding);
     const struct behavior_sensor_rotate_config *cfg = dev->config;
     struct behavior_sensor_rotate_data *data = dev->data;
 
@@ -73,13 +81,15 @@ int zmk_behavior_sensor_rotate_common_process(struct zmk_behavior_binding *bindi
 
     struct zmk_behavior_binding triggered_binding;
     if (triggers > 0) {
-        triggered_binding = cfg->cw_binding;
+        behavior_binding_get_device(&data->cw_binding);
+        triggered_binding = data->cw_binding;
         if (cfg->override_params) {
             triggered_binding.param1 = binding->param1;
         }
     } else if (triggers < 0) {
         triggers = -triggers;
-        triggered_binding = cfg->ccw_binding;
+        behavior_binding_get_device(&data->ccw_binding);
+        triggered_binding = data->ccw_binding;
         if (cfg->override_params) {
             triggered_binding.param1 = binding->param2;
         }
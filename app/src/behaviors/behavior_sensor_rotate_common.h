@@ -10,17 +10,18 @@
 #include <zmk/sensors.h>
 
 struct behavior_sensor_rotate_config {
-    struct zmk_behavior_binding cw_binding;
-    struct zmk_behavior_binding ccw_binding;
     int tap_ms;
     bool override_params;
 };
 
 struct behavior_sensor_rotate_data {
+    struct zmk_behavior_binding cw_binding;
+    struct zmk_behavior_binding ccw_binding;
     struct sensor_value remainder[ZMK_KEYMAP_SENSORS_LEN][ZMK_KEYMAP_LAYERS_LEN];
     int triggers[ZMK_KEYMAP_SENSORS_LEN][ZMK_KEYMAP_LAYERS_LEN];
 };
 
+int zmk_behavior_sensor_rotate_common_init(const struct device *dev);
 int zmk_behavior_sensor_rotate_common_accept_data(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event,
     const struct zmk_sensor_config *sensor_config, size_t channel_data_size,
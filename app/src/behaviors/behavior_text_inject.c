@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_behavior_text_inject
+
+#include <zephyr/device.h>
+#include <drivers/behavior.h>
+#include <zephyr/logging/log.h>
+
+#include <zmk/behavior.h>
+#include <zmk/text_inject.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+struct behavior_text_inject_config {
+    size_t keys_len;
+    const uint32_t *keys;
+};
+
+static int behavior_text_inject_init(const struct device *dev) { return 0; };
+
+static int on_keymap_binding_pressed(struct zmk_behavior_binding *binding,
+                                     struct zmk_behavior_binding_event event) {
+    const struct device *dev = behavior_binding_get_device(binding);
+    const struct behavior_text_inject_config *cfg = dev->config;
+
+    LOG_DBG("position %d injecting %d keys", event.position, (int)cfg->keys_len);
+    zmk_text_inject(cfg->keys, cfg->keys_len);
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static int on_keymap_binding_released(struct zmk_behavior_binding *binding,
+                                      struct zmk_behavior_binding_event event) {
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static const struct behavior_driver_api behavior_text_inject_driver_api = {
+    .binding_pressed = on_keymap_binding_pressed, .binding_released = on_keymap_binding_released};
+
+#define TI_INST(n)                                                                                 \
+    static const uint32_t behavior_text_inject_keys_##n[] = DT_INST_PROP(n, keys);                 \
+    static const struct behavior_text_inject_config behavior_text_inject_config_##n = {            \
+        .keys_len = ARRAY_SIZE(behavior_text_inject_keys_##n),                                     \
+        .keys = behavior_text_inject_keys_##n,                                                     \
+    };                                                                                             \
+    DEVICE_DT_INST_DEFINE(n, behavior_text_inject_init, NULL, NULL,                                \
+                          &behavior_text_inject_config_##n, APPLICATION,                           \
+                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_text_inject_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(TI_INST)
@@ -127,6 +127,28 @@ bool zmk_ble_active_profile_is_connected() {
     return info.state == BT_CONN_STATE_CONNECTED;
 }
 
+int zmk_ble_active_profile_conn_interval_ms() {
+    struct bt_conn *conn;
+    struct bt_conn_info info;
+    bt_addr_le_t *addr = zmk_ble_active_profile_addr();
+    if (!bt_addr_le_cmp(addr, BT_ADDR_LE_ANY)) {
+        return -ENOTCONN;
+    } else if ((conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, addr)) == NULL) {
+        return -ENOTCONN;
+    }
+
+    bt_conn_get_info(conn, &info);
+
+    bt_conn_unref(conn);
+
+    if (info.state != BT_CONN_STATE_CONNECTED) {
+        return -ENOTCONN;
+    }
+
+    // The interval is counted in units of 1.25 ms
+    return DIV_ROUND_UP(info.le.interval * 5, 4);
+}
+
 #define CHECKED_ADV_STOP()                                                                         \
     err = bt_le_adv_stop();                                                                        \
     advertising_status = ZMK_ADV_NONE;                                                             \
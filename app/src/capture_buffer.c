@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/capture_buffer.h>
+#include <zmk/events/position_state_changed.h>
+
+static inline const zmk_event_t **slot(struct zmk_capture_buffer *buf, uint32_t seq) {
+    return &buf->events[seq % buf->size];
+}
+
+// Drop released slots from the front, and restart the sequence numbers once the buffer is empty.
+static void trim(struct zmk_capture_buffer *buf) {
+    while (buf->head != buf->tail && *slot(buf, buf->head) == NULL) {
+        buf->head++;
+    }
+
+    if (buf->head == buf->tail) {
+        buf->head = buf->segment = buf->tail = 0;
+    }
+}
+
+static void update_keydown(struct zmk_capture_buffer *buf, const zmk_event_t *event, bool set) {
+    const struct zmk_position_state_changed *ev = as_zmk_position_state_changed(event);
+
+    if (ev == NULL || !ev->state || ev->position >= ZMK_KEYMAP_LEN) {
+        return;
+    }
+
+    if (set) {
+        buf->keydowns[ev->position / 32] |= BIT(ev->position % 32);
+    } else {
+        buf->keydowns[ev->position / 32] &= ~BIT(ev->position % 32);
+    }
+}
+
+int zmk_capture_buffer_push(struct zmk_capture_buffer *buf, const zmk_event_t *event) {
+    if (buf->tail - buf->head == buf->size) {
+        buf->stats.overflows++;
+        LOG_WRN("Unable to capture event, all %d slots are in use", buf->size);
+        return -ENOMEM;
+    }
+
+    *slot(buf, buf->tail) = event;
+    buf->tail++;
+    buf->stats.high_water = MAX(buf->stats.high_water, buf->tail - buf->head);
+    update_keydown(buf, event, true);
+    return 0;
+}
+
+const zmk_event_t *zmk_capture_buffer_take(struct zmk_capture_buffer *buf) {
+    if (buf->segment == buf->tail) {
+        return NULL;
+    }
+
+    const zmk_event_t *event = *slot(buf, buf->segment);
+    *slot(buf, buf->segment) = NULL;
+    buf->segment++;
+    update_keydown(buf, event, false);
+    trim(buf);
+    return event;
+}
+
+size_t zmk_capture_buffer_release(struct zmk_capture_buffer *buf,
+                                  zmk_capture_buffer_release_t release) {
+    uint32_t start = buf->segment;
+    uint32_t end = buf->tail;
+
+    // Anything captured from here on belongs to the next segment.
+    buf->segment = end;
+    memset(buf->keydowns, 0, sizeof(buf->keydowns));
+
+    for (uint32_t seq = start; seq != end; seq++) {
+        const zmk_event_t *event = *slot(buf, seq);
+        *slot(buf, seq) = NULL;
+        // The buffer can only run empty here on the last event, after which the loop ends, so the
+        // sequence numbers of the remaining events stay valid.
+        trim(buf);
+        release(event, seq - start);
+    }
+
+    return end - start;
+}
@@ -14,22 +14,51 @@
 #include <drivers/behavior.h>
 
 #include <zmk/behavior.h>
+#include <zmk/capture_buffer.h>
+#include <zmk/decision_stats.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/matrix.h>
 #include <zmk/keymap.h>
+#include <zmk/timer_wheel.h>
 #include <zmk/virtual_key_position.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
+// Number of words in a bitset with one bit per key position. LISTIFY needs a literal, so the
+// supported keymap sizes are spelled out.
+#if ZMK_KEYMAP_LEN <= 32
+#define COMBO_POSITION_WORDS 1
+#elif ZMK_KEYMAP_LEN <= 64
+#define COMBO_POSITION_WORDS 2
+#elif ZMK_KEYMAP_LEN <= 96
+#define COMBO_POSITION_WORDS 3
+#elif ZMK_KEYMAP_LEN <= 128
+#define COMBO_POSITION_WORDS 4
+#elif ZMK_KEYMAP_LEN <= 160
+#define COMBO_POSITION_WORDS 5
+#elif ZMK_KEYMAP_LEN <= 192
+#define COMBO_POSITION_WORDS 6
+#elif ZMK_KEYMAP_LEN <= 224
+#define COMBO_POSITION_WORDS 7
+#elif ZMK_KEYMAP_LEN <= 256
+#define COMBO_POSITION_WORDS 8
+#else
+#error "Combos support keymaps with up to 256 key positions"
+#endif
+
+// The combo table is built from the devicetree at compile time and lives in flash, in devicetree
+// order, so virtual key positions increase with the index in the table.
 struct combo_cfg {
-    int32_t key_positions[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
     int32_t key_position_len;
-    struct zmk_behavior_binding behavior;
+    // bitset of the key positions of the combo
+    uint32_t key_position_mask[COMBO_POSITION_WORDS];
+    // bitset of the layers the combo is active on
+    zmk_keymap_layers_state_t layer_mask;
     int32_t timeout_ms;
     int32_t require_prior_idle_ms;
     // if slow release is set, the combo releases when the last key is released.
@@ -38,41 +67,105 @@ struct combo_cfg {
     // the virtual key position is a key position outside the range used by the keyboard.
     // it is necessary so hold-taps can uniquely identify a behavior.
     int32_t virtual_key_position;
-    int32_t layers_len;
-    int8_t layers[];
+    const struct zmk_decision_stats *stats;
 };
 
 struct active_combo {
-    struct combo_cfg *combo;
+    const struct combo_cfg *combo;
     // key_positions_pressed is filled with key_positions when the combo is pressed.
     // The keys are removed from this array when they are released.
     // Once this array is empty, the behavior is released.
     const zmk_event_t *key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
 };
 
-struct combo_candidate {
-    struct combo_cfg *combo;
-    // the time after which this behavior should be removed from candidates.
-    // by keeping track of when the candidate should be cleared there is no
-    // possibility of accidental releases.
-    int64_t timeout_at;
+// the reasons a combo stops being a candidate
+enum combo_decision {
+    COMBO_DECISION_ACTIVATED,
+    COMBO_DECISION_OTHER_KEY_DOWN,
+    COMBO_DECISION_KEY_UP,
+    COMBO_DECISION_TIMEOUT,
+};
+
+static const char *const combo_decision_names[] __maybe_unused = {
+    [COMBO_DECISION_ACTIVATED] = "activated",
+    [COMBO_DECISION_OTHER_KEY_DOWN] = "other-key-down",
+    [COMBO_DECISION_KEY_UP] = "key-up",
+    [COMBO_DECISION_TIMEOUT] = "timeout",
 };
 
-// set of keys pressed
-const zmk_event_t *pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {NULL};
-// the set of candidate combos based on the currently pressed_keys
-struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+#define COMBO_STATS_VAR(n) _CONCAT(combo_stats_, DT_DEP_ORD(n))
+
+#define COMBO_STATS(n)                                                                             \
+    ZMK_DECISION_STATS_DEFINE(COMBO_STATS_VAR(n), DT_NODE_FULL_NAME(n), combo_decision_names);
+
+#define COMBO_POSITION_BIT(node_id, prop, idx, word)                                               \
+    | ((DT_PROP_BY_IDX(node_id, prop, idx) / 32 == (word))                                         \
+           ? BIT(DT_PROP_BY_IDX(node_id, prop, idx) % 32)                                          \
+           : 0)
+
+#define COMBO_POSITION_WORD(word, node_id)                                                         \
+    (0 DT_FOREACH_PROP_ELEM_VARGS(node_id, key_positions, COMBO_POSITION_BIT, word))
+
+#define COMBO_LAYER_BIT(node_id, prop, idx)                                                        \
+    | ZMK_KEYMAP_LAYER_BIT(DT_PROP_BY_IDX(node_id, prop, idx))
+
+// -1 in the first layer position is global layer scope
+#define COMBO_LAYER_MASK(n)                                                                        \
+    (((int8_t)DT_PROP_BY_IDX(n, layers, 0) == -1)                                                  \
+         ? ~(zmk_keymap_layers_state_t)0                                                           \
+         : (0 DT_FOREACH_PROP_ELEM(n, layers, COMBO_LAYER_BIT)))
+
+#define COMBO_CHECK_POSITION(node_id, prop, idx)                                                   \
+    BUILD_ASSERT(DT_PROP_BY_IDX(node_id, prop, idx) < ZMK_KEYMAP_LEN,                              \
+                 "Combo " DT_NODE_FULL_NAME(node_id) " uses a key position that does not exist");
+
+#define COMBO_CHECK(n)                                                                             \
+    BUILD_ASSERT(DT_PROP_LEN(n, key_positions) <= CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO,             \
+                 "Combo " DT_NODE_FULL_NAME(n) " has more keys than "                              \
+                 "CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO");                                           \
+    DT_FOREACH_PROP_ELEM(n, key_positions, COMBO_CHECK_POSITION)
+
+#define COMBO_INST(n)                                                                              \
+    {                                                                                              \
+        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
+        .key_position_mask = {LISTIFY(COMBO_POSITION_WORDS, COMBO_POSITION_WORD, (, ), n)},        \
+        .layer_mask = COMBO_LAYER_MASK(n),                                                         \
+        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
+        .require_prior_idle_ms = DT_PROP(n, require_prior_idle_ms),                                \
+        .virtual_key_position = ZMK_VIRTUAL_KEY_POSITION_COMBO(__COUNTER__),                       \
+        .slow_release = DT_PROP(n, slow_release),                                                  \
+        .stats = ZMK_DECISION_STATS_REF(COMBO_STATS_VAR(n)),                                       \
+    },
+
+#define COMBO_BINDING(n) ZMK_KEYMAP_EXTRACT_BINDING(0, n),
+
+DT_INST_FOREACH_CHILD(0, COMBO_CHECK)
+DT_INST_FOREACH_CHILD(0, COMBO_STATS)
+
+static const struct combo_cfg combos[] = {DT_INST_FOREACH_CHILD(0, COMBO_INST)};
+// the behavior bindings of the combos, by index in combos. these stay in RAM since a binding
+// caches its behavior device.
+static struct zmk_behavior_binding combo_bindings[] = {DT_INST_FOREACH_CHILD(0, COMBO_BINDING)};
+
+#define COMBO_WORDS DIV_ROUND_UP(ARRAY_SIZE(combos), 32)
+
+// set of keys pressed. while release_pressed_keys reraises them, the keys pressed so far can be
+// captured again, so there is room for two combos worth of keys.
+ZMK_CAPTURE_BUFFER_DEFINE(pressed_keys, 2 * CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO);
+// bitset of the indices in combos that are candidates based on the currently pressed_keys.
+uint32_t candidates[COMBO_WORDS];
+// the time of the keypress that set up the candidates. a candidate is removed once its
+// timeout has passed since then, so there is no possibility of accidental releases.
+int64_t candidates_timestamp;
 // the last candidate that was completely pressed
-struct combo_cfg *fully_pressed_combo = NULL;
-// a lookup dict that maps a key position to all combos on that position
-struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
+const struct combo_cfg *fully_pressed_combo = NULL;
 // combos that have been activated and still have (some) keys pressed
 // this array is always contiguous from 0.
 struct active_combo active_combos[CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS] = {NULL};
 int active_combo_count = 0;
 
-struct k_work_delayable timeout_task;
-int64_t timeout_task_timeout_at;
+// expires at the first candidate timeout
+struct zmk_timer timeout_timer;
 
 // this keeps track of the last non-combo, non-mod key tap
 int64_t last_tapped_timestamp = INT32_MIN;
@@ -85,133 +178,118 @@ static void store_last_tapped(int64_t timestamp) {
     }
 }
 
-// Store the combo key pointer in the combos array, one pointer for each key position
-// The combos are sorted shortest-first, then by virtual-key-position.
-static int initialize_combo(struct combo_cfg *new_combo) {
-    for (int i = 0; i < new_combo->key_position_len; i++) {
-        int32_t position = new_combo->key_positions[i];
-        if (position >= ZMK_KEYMAP_LEN) {
-            LOG_ERR("Unable to initialize combo, key position %d does not exist", position);
-            return -EINVAL;
-        }
+static inline bool combo_has_position(const struct combo_cfg *combo, int32_t position) {
+    return combo->key_position_mask[position / 32] & BIT(position % 32);
+}
 
-        struct combo_cfg *insert_combo = new_combo;
-        bool set = false;
-        for (int j = 0; j < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; j++) {
-            struct combo_cfg *combo_at_j = combo_lookup[position][j];
-            if (combo_at_j == NULL) {
-                combo_lookup[position][j] = insert_combo;
-                set = true;
-                break;
-            }
-            if (combo_at_j->key_position_len < insert_combo->key_position_len ||
-                (combo_at_j->key_position_len == insert_combo->key_position_len &&
-                 combo_at_j->virtual_key_position < insert_combo->virtual_key_position)) {
-                continue;
-            }
-            // put insert_combo in this spot, move all other combos up.
-            combo_lookup[position][j] = insert_combo;
-            insert_combo = combo_at_j;
-        }
-        if (!set) {
-            LOG_ERR("Too many combos for key position %d, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY %d.",
-                    position, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY);
-            return -ENOMEM;
+// returns true if every position in the positions bitset is part of the combo
+static inline bool combo_has_positions(const struct combo_cfg *combo, const uint32_t *positions) {
+    for (int i = 0; i < COMBO_POSITION_WORDS; i++) {
+        if ((combo->key_position_mask[i] & positions[i]) != positions[i]) {
+            return false;
         }
     }
-    return 0;
+    return true;
 }
 
-static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
-    if (combo->layers[0] == -1) {
-        // -1 in the first layer position is global layer scope
-        return true;
-    }
-    for (int j = 0; j < combo->layers_len; j++) {
-        if (combo->layers[j] == layer) {
-            return true;
-        }
-    }
-    return false;
+static bool combo_active_on_layer(const struct combo_cfg *combo, uint8_t layer) {
+    return combo->layer_mask & ZMK_KEYMAP_LAYER_BIT(layer);
 }
 
-static bool is_quick_tap(struct combo_cfg *combo, int64_t timestamp) {
+static bool is_quick_tap(const struct combo_cfg *combo, int64_t timestamp) {
     return (last_tapped_timestamp + combo->require_prior_idle_ms) > timestamp;
 }
 
+static inline int64_t candidate_timeout(const struct combo_cfg *combo) {
+    return candidates_timestamp + combo->timeout_ms;
+}
+
+static void record_decision(const struct combo_cfg *combo, enum combo_decision decision) {
+    // a fully pressed combo that stops being a candidate is still activated by cleanup.
+    if (combo == fully_pressed_combo && decision != COMBO_DECISION_ACTIVATED) {
+        return;
+    }
+    zmk_decision_stats_record(combo->stats, decision, k_uptime_get() - candidates_timestamp);
+}
+
+// the preferred candidate is the shortest one, then the one with the lowest virtual key position.
+static const struct combo_cfg *first_candidate() {
+    const struct combo_cfg *first = NULL;
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        uint32_t word = candidates[i];
+        while (word != 0) {
+            const struct combo_cfg *combo = &combos[i * 32 + __builtin_ctz(word)];
+            word &= word - 1;
+            if (first == NULL || combo->key_position_len < first->key_position_len) {
+                first = combo;
+            }
+        }
+    }
+    return first;
+}
+
 static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
     int number_of_combo_candidates = 0;
     uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_cfg *combo = combo_lookup[position][i];
-        if (combo == NULL) {
-            return number_of_combo_candidates;
-        }
-        if (combo_active_on_layer(combo, highest_active_layer) && !is_quick_tap(combo, timestamp)) {
-            candidates[number_of_combo_candidates].combo = combo;
-            candidates[number_of_combo_candidates].timeout_at = timestamp + combo->timeout_ms;
+    for (int i = 0; i < ARRAY_SIZE(combos); i++) {
+        const struct combo_cfg *combo = &combos[i];
+        if (combo_has_position(combo, position) &&
+            combo_active_on_layer(combo, highest_active_layer) && !is_quick_tap(combo, timestamp)) {
+            candidates[i / 32] |= BIT(i % 32);
             number_of_combo_candidates++;
         }
-        // LOG_DBG("combo timeout %d %d %d", position, i, candidates[i].timeout_at);
     }
+    candidates_timestamp = timestamp;
     return number_of_combo_candidates;
 }
 
 static int filter_candidates(int32_t position) {
-    // this code iterates over candidates and the lookup together to filter in O(n)
-    // assuming they are both sorted on key_position_len, virtal_key_position
-    int matches = 0, lookup_idx = 0, candidate_idx = 0;
-    while (lookup_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY &&
-           candidate_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY) {
-        struct combo_cfg *candidate = candidates[candidate_idx].combo;
-        struct combo_cfg *lookup = combo_lookup[position][lookup_idx];
-        if (candidate == NULL || lookup == NULL) {
-            break;
-        }
-        if (candidate->virtual_key_position == lookup->virtual_key_position) {
-            candidates[matches] = candidates[candidate_idx];
-            matches++;
-            candidate_idx++;
-            lookup_idx++;
-        } else if (candidate->key_position_len > lookup->key_position_len) {
-            lookup_idx++;
-        } else if (candidate->key_position_len < lookup->key_position_len) {
-            candidate_idx++;
-        } else if (candidate->virtual_key_position > lookup->virtual_key_position) {
-            lookup_idx++;
-        } else if (candidate->virtual_key_position < lookup->virtual_key_position) {
-            candidate_idx++;
+    // keep the candidates that contain all pressed keys, including the one at position.
+    uint32_t positions[COMBO_POSITION_WORDS];
+    memcpy(positions, pressed_keys.keydowns, sizeof(positions));
+    positions[position / 32] |= BIT(position % 32);
+
+    int matches = 0;
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        uint32_t word = candidates[i];
+        while (word != 0) {
+            int bit = __builtin_ctz(word);
+            word &= word - 1;
+            if (combo_has_positions(&combos[i * 32 + bit], positions)) {
+                matches++;
+            } else {
+                candidates[i] &= ~BIT(bit);
+                record_decision(&combos[i * 32 + bit], COMBO_DECISION_OTHER_KEY_DOWN);
+            }
         }
     }
-    // clear unmatched candidates
-    for (int i = matches; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        candidates[i].combo = NULL;
-    }
     // LOG_DBG("combo matches after filter %d", matches);
     return matches;
 }
 
 static int64_t first_candidate_timeout() {
-    int64_t first_timeout = LONG_MAX;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            break;
-        }
-        if (candidates[i].timeout_at < first_timeout) {
-            first_timeout = candidates[i].timeout_at;
+    int64_t first_timeout = LLONG_MAX;
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        uint32_t word = candidates[i];
+        while (word != 0) {
+            int64_t timeout_at = candidate_timeout(&combos[i * 32 + __builtin_ctz(word)]);
+            word &= word - 1;
+            if (timeout_at < first_timeout) {
+                first_timeout = timeout_at;
+            }
         }
     }
     return first_timeout;
 }
 
-static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
-    // this code assumes set(pressed_keys) <= set(candidate->key_positions)
-    // this invariant is enforced by filter_candidates
-    // since events may have been reraised after clearing one or more slots at
-    // the start of pressed_keys (see: release_pressed_keys), we have to check
-    // that each key needed to trigger the combo was pressed, not just the last.
-    for (int i = 0; i < candidate->key_position_len; i++) {
-        if (pressed_keys[i] == NULL) {
+static inline bool candidate_is_completely_pressed(const struct combo_cfg *candidate) {
+    // this code assumes set(pressed_keys) <= set(candidate->key_position_mask)
+    // this invariant is enforced by filter_candidates.
+    // the keydowns of pressed_keys only hold keys captured since the candidates were set up, so
+    // keys waiting to be reraised by release_pressed_keys do not count.
+    for (int i = 0; i < COMBO_POSITION_WORDS; i++) {
+        if ((pressed_keys.keydowns[i] & candidate->key_position_mask[i]) !=
+            candidate->key_position_mask[i]) {
             return false;
         }
     }
@@ -222,25 +300,17 @@ static int cleanup();
 
 static int filter_timed_out_candidates(int64_t timestamp) {
     int remaining_candidates = 0;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_candidate *candidate = &candidates[i];
-        if (candidate->combo == NULL) {
-            break;
-        }
-        if (candidate->timeout_at > timestamp) {
-            bool need_to_bubble_up = remaining_candidates != i;
-            if (need_to_bubble_up) {
-                // bubble up => reorder candidates so they're contiguous
-                candidates[remaining_candidates].combo = candidate->combo;
-                candidates[remaining_candidates].timeout_at = candidate->timeout_at;
-                // clear the previous location
-                candidates[i].combo = NULL;
-                candidates[i].timeout_at = 0;
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        uint32_t word = candidates[i];
+        while (word != 0) {
+            int bit = __builtin_ctz(word);
+            word &= word - 1;
+            if (candidate_timeout(&combos[i * 32 + bit]) > timestamp) {
+                remaining_candidates++;
+            } else {
+                candidates[i] &= ~BIT(bit);
+                record_decision(&combos[i * 32 + bit], COMBO_DECISION_TIMEOUT);
             }
-
-            remaining_candidates++;
-        } else {
-            candidate->combo = NULL;
         }
     }
 
@@ -251,51 +321,46 @@ static int filter_timed_out_candidates(int64_t timestamp) {
     return remaining_candidates;
 }
 
-static int clear_candidates() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            return i;
+static void clear_candidates() {
+    if (IS_ENABLED(CONFIG_ZMK_DECISION_STATS)) {
+        // apart from a fully pressed combo, only a key release leaves candidates behind.
+        for (int i = 0; i < COMBO_WORDS; i++) {
+            for (uint32_t word = candidates[i]; word != 0; word &= word - 1) {
+                record_decision(&combos[i * 32 + __builtin_ctz(word)], COMBO_DECISION_KEY_UP);
+            }
         }
-        candidates[i].combo = NULL;
     }
-    return CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY;
+    memset(candidates, 0, sizeof(candidates));
 }
 
 static int capture_pressed_key(const zmk_event_t *ev) {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
-        if (pressed_keys[i] != NULL) {
-            continue;
-        }
-        pressed_keys[i] = ev;
-        return ZMK_EV_EVENT_CAPTURED;
+    if (zmk_capture_buffer_segment_len(&pressed_keys) >= CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO ||
+        zmk_capture_buffer_push(&pressed_keys, ev) < 0) {
+        return ZMK_EV_EVENT_BUBBLE;
     }
-    return ZMK_EV_EVENT_BUBBLE;
+    return ZMK_EV_EVENT_CAPTURED;
 }
 
 const struct zmk_listener zmk_listener_combo;
 
-static int release_pressed_keys() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
-        const zmk_event_t *captured_event = pressed_keys[i];
-        if (pressed_keys[i] == NULL) {
-            return i;
-        }
-        pressed_keys[i] = NULL;
-        if (i == 0) {
-            LOG_DBG("combo: releasing position event %d",
-                    as_zmk_position_state_changed(captured_event)->position);
-            ZMK_EVENT_RELEASE(captured_event)
-        } else {
-            // reprocess events (see tests/combo/fully-overlapping-combos-3 for why this is needed)
-            LOG_DBG("combo: reraising position event %d",
-                    as_zmk_position_state_changed(captured_event)->position);
-            ZMK_EVENT_RAISE(captured_event);
-        }
+static void release_pressed_key(const zmk_event_t *captured_event, size_t index) {
+    if (index == 0) {
+        LOG_DBG("combo: releasing position event %d",
+                as_zmk_position_state_changed(captured_event)->position);
+        ZMK_EVENT_RELEASE(captured_event)
+    } else {
+        // reprocess events (see tests/combo/fully-overlapping-combos-3 for why this is needed)
+        LOG_DBG("combo: reraising position event %d",
+                as_zmk_position_state_changed(captured_event)->position);
+        ZMK_EVENT_RAISE(captured_event);
     }
-    return CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO;
 }
 
-static inline int press_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
+static int release_pressed_keys() {
+    return zmk_capture_buffer_release(&pressed_keys, release_pressed_key);
+}
+
+static inline int press_combo_behavior(const struct combo_cfg *combo, int32_t timestamp) {
     struct zmk_behavior_binding_event event = {
         .position = combo->virtual_key_position,
         .timestamp = timestamp,
@@ -303,35 +368,26 @@ static inline int press_combo_behavior(struct combo_cfg *combo, int32_t timestam
 
     last_combo_timestamp = timestamp;
 
-    return behavior_keymap_binding_pressed(&combo->behavior, event);
+    return behavior_keymap_binding_pressed(&combo_bindings[combo - combos], event);
 }
 
-static inline int release_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
+static inline int release_combo_behavior(const struct combo_cfg *combo, int32_t timestamp) {
     struct zmk_behavior_binding_event event = {
         .position = combo->virtual_key_position,
         .timestamp = timestamp,
     };
 
-    return behavior_keymap_binding_released(&combo->behavior, event);
+    return behavior_keymap_binding_released(&combo_bindings[combo - combos], event);
 }
 
 static void move_pressed_keys_to_active_combo(struct active_combo *active_combo) {
-    int combo_length = active_combo->combo->key_position_len;
-    for (int i = 0; i < combo_length; i++) {
-        active_combo->key_positions_pressed[i] = pressed_keys[i];
-        pressed_keys[i] = NULL;
-    }
-    // move any other pressed keys up
-    for (int i = 0; i + combo_length < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
-        if (pressed_keys[i + combo_length] == NULL) {
-            return;
-        }
-        pressed_keys[i] = pressed_keys[i + combo_length];
-        pressed_keys[i + combo_length] = NULL;
+    // the keys of the combo were pressed first, any keys after them stay in pressed_keys.
+    for (int i = 0; i < active_combo->combo->key_position_len; i++) {
+        active_combo->key_positions_pressed[i] = zmk_capture_buffer_take(&pressed_keys);
     }
 }
 
-static struct active_combo *store_active_combo(struct combo_cfg *combo) {
+static struct active_combo *store_active_combo(const struct combo_cfg *combo) {
     for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS; i++) {
         if (active_combos[i].combo == NULL) {
             active_combos[i].combo = combo;
@@ -345,13 +401,14 @@ static struct active_combo *store_active_combo(struct combo_cfg *combo) {
     return NULL;
 }
 
-static void activate_combo(struct combo_cfg *combo) {
+static void activate_combo(const struct combo_cfg *combo) {
     struct active_combo *active_combo = store_active_combo(combo);
     if (active_combo == NULL) {
         // unable to store combo
         release_pressed_keys();
         return;
     }
+    record_decision(combo, COMBO_DECISION_ACTIVATED);
     move_pressed_keys_to_active_combo(active_combo);
     press_combo_behavior(
         combo, as_zmk_position_state_changed(active_combo->key_positions_pressed[0])->timestamp);
@@ -403,7 +460,7 @@ static bool release_combo_key(int32_t position, int64_t timestamp) {
 }
 
 static int cleanup() {
-    k_work_cancel_delayable(&timeout_task);
+    zmk_timer_stop(&timeout_timer);
     clear_candidates();
     if (fully_pressed_combo != NULL) {
         activate_combo(fully_pressed_combo);
@@ -412,24 +469,21 @@ static int cleanup() {
     return release_pressed_keys();
 }
 
-static void update_timeout_task() {
+static void update_timeout_timer() {
     int64_t first_timeout = first_candidate_timeout();
-    if (timeout_task_timeout_at == first_timeout) {
-        return;
-    }
     if (first_timeout == LLONG_MAX) {
-        timeout_task_timeout_at = 0;
-        k_work_cancel_delayable(&timeout_task);
+        zmk_timer_stop(&timeout_timer);
         return;
     }
-    if (k_work_schedule(&timeout_task, K_MSEC(first_timeout - k_uptime_get())) >= 0) {
-        timeout_task_timeout_at = first_timeout;
+    if (zmk_timer_is_running(&timeout_timer) && timeout_timer.deadline == first_timeout) {
+        return;
     }
+    zmk_timer_start(&timeout_timer, first_timeout);
 }
 
 static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
     int num_candidates;
-    if (candidates[0].combo == NULL) {
+    if (first_candidate() == NULL) {
         num_candidates = setup_candidates_for_first_keypress(data->position, data->timestamp);
         if (num_candidates == 0) {
             return ZMK_EV_EVENT_BUBBLE;
@@ -438,9 +492,9 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
         filter_timed_out_candidates(data->timestamp);
         num_candidates = filter_candidates(data->position);
     }
-    update_timeout_task();
+    update_timeout_timer();
 
-    struct combo_cfg *candidate_combo = candidates[0].combo;
+    const struct combo_cfg *candidate_combo = first_candidate();
     LOG_DBG("combo: capturing position event %d", data->position);
     int ret = capture_pressed_key(ev);
     switch (num_candidates) {
@@ -475,15 +529,11 @@ static int position_state_up(const zmk_event_t *ev, struct zmk_position_state_ch
     return ZMK_EV_EVENT_BUBBLE;
 }
 
-static void combo_timeout_handler(struct k_work *item) {
-    if (timeout_task_timeout_at == 0 || k_uptime_get() < timeout_task_timeout_at) {
-        // timer was cancelled or rescheduled.
-        return;
-    }
-    if (filter_timed_out_candidates(timeout_task_timeout_at) == 0) {
+static void combo_timeout_handler(struct zmk_timer *timer) {
+    if (filter_timed_out_candidates(timer->deadline) == 0) {
         cleanup();
     }
-    update_timeout_task();
+    update_timeout_timer();
 }
 
 static int position_state_changed_listener(const zmk_event_t *ev) {
@@ -520,26 +570,8 @@ ZMK_LISTENER(combo, behavior_combo_listener);
 ZMK_SUBSCRIPTION(combo, zmk_position_state_changed);
 ZMK_SUBSCRIPTION(combo, zmk_keycode_state_changed);
 
-#define COMBO_INST(n)                                                                              \
-    static struct combo_cfg combo_config_##n = {                                                   \
-        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
-        .require_prior_idle_ms = DT_PROP(n, require_prior_idle_ms),                                \
-        .key_positions = DT_PROP(n, key_positions),                                                \
-        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
-        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
-        .virtual_key_position = ZMK_VIRTUAL_KEY_POSITION_COMBO(__COUNTER__),                       \
-        .slow_release = DT_PROP(n, slow_release),                                                  \
-        .layers = DT_PROP(n, layers),                                                              \
-        .layers_len = DT_PROP_LEN(n, layers),                                                      \
-    };
-
-#define INITIALIZE_COMBO(n) initialize_combo(&combo_config_##n);
-
-DT_INST_FOREACH_CHILD(0, COMBO_INST)
-
 static int combo_init() {
-    k_work_init_delayable(&timeout_task, combo_timeout_handler);
-    DT_INST_FOREACH_CHILD(0, INITIALIZE_COMBO);
+    zmk_timer_init(&timeout_timer, combo_timeout_handler);
     return 0;
 }
 
@@ -33,7 +33,7 @@ struct conditional_layer_cfg {
     int8_t then_layer;
 };
 
-#define IF_LAYER_BIT(node_id, prop, idx) BIT(DT_PROP_BY_IDX(node_id, prop, idx)) |
+#define IF_LAYER_BIT(node_id, prop, idx) ZMK_KEYMAP_LAYER_BIT(DT_PROP_BY_IDX(node_id, prop, idx)) |
 
 // Evaluates to conditional_layer_cfg struct initializer.
 #define CONDITIONAL_LAYER_DECL(n)                                                                  \
@@ -49,69 +49,83 @@ static const struct conditional_layer_cfg CONDITIONAL_LAYER_CFGS[] = {
 static const int32_t NUM_CONDITIONAL_LAYER_CFGS =
     sizeof(CONDITIONAL_LAYER_CFGS) / sizeof(*CONDITIONAL_LAYER_CFGS);
 
-static void conditional_layer_activate(int8_t layer) {
-    // This may trigger another event that could, in turn, activate additional then-layers. However,
-    // the process will eventually terminate (at worst, when every layer is active).
-    if (!zmk_keymap_layer_active(layer)) {
+static void conditional_layer_activate(zmk_keymap_layers_state_t *state, int8_t layer) {
+    if (!(*state & ZMK_KEYMAP_LAYER_BIT(layer))) {
         LOG_DBG("layer %d", layer);
-        zmk_keymap_layer_activate(layer);
+        *state |= ZMK_KEYMAP_LAYER_BIT(layer);
     }
 }
 
-static void conditional_layer_deactivate(int8_t layer) {
+static void conditional_layer_deactivate(zmk_keymap_layers_state_t *state, int8_t layer) {
     // This may deactivate a then-layer that's already active via another mechanism (e.g., a
     // momentary layer behavior). However, the same problem arises when multiple keys with the same
     // &mo binding are held and then one is released, so it's probably not an issue in practice.
-    if (zmk_keymap_layer_active(layer)) {
+    if (*state & ZMK_KEYMAP_LAYER_BIT(layer)) {
         LOG_DBG("layer %d", layer);
-        zmk_keymap_layer_deactivate(layer);
+        *state &= ~ZMK_KEYMAP_LAYER_BIT(layer);
     }
 }
 
-static int layer_state_changed_listener(const zmk_event_t *ev) {
-    static bool conditional_layer_updates_needed;
-
-    conditional_layer_updates_needed = true;
-
-    // Semaphore ensures we don't re-enter the loop in the middle of doing update, and
-    // ensures that "waterfalling layer updates" are all processed to trigger subsequent
-    // nested conditional layers properly.
-    if (k_sem_take(&conditional_layer_sem, K_NO_WAIT) < 0) {
-        return 0;
-    }
-
-    while (conditional_layer_updates_needed) {
+// Computes the layer state with every then-layer active if and only if all of its if-layers are
+// active. Activating a then-layer can in turn activate additional then-layers, so this repeats
+// until the state settles and all waterfalling updates end up in a single layer state change.
+static zmk_keymap_layers_state_t conditional_layer_state(zmk_keymap_layers_state_t state) {
+    // Each pass settles at least one more config, unless configs contradict each other
+    for (int pass = 0; pass <= NUM_CONDITIONAL_LAYER_CFGS; pass++) {
+        zmk_keymap_layers_state_t old_state = state;
         int8_t max_then_layer = -1;
-        uint32_t then_layers = 0;
-        uint32_t then_layer_state = 0;
-
-        conditional_layer_updates_needed = false;
+        zmk_keymap_layers_state_t then_layers = 0;
+        zmk_keymap_layers_state_t then_layer_state = 0;
 
-        // On layer state changes, examines each conditional layer config to determine if then-layer
-        // in the config should activate based on the currently active set of if-layers.
         for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS; i++) {
             const struct conditional_layer_cfg *cfg = CONDITIONAL_LAYER_CFGS + i;
             zmk_keymap_layers_state_t mask = cfg->if_layers_state_mask;
-            then_layers |= BIT(cfg->then_layer);
+            then_layers |= ZMK_KEYMAP_LAYER_BIT(cfg->then_layer);
             max_then_layer = MAX(max_then_layer, cfg->then_layer);
 
-            // Activate then-layer if and only if all if-layers are already active. Note that we
-            // reevaluate the current layer state for each config since activation of one layer can
-            // also trigger activation of another.
-            if ((zmk_keymap_layer_state() & mask) == mask) {
-                then_layer_state |= BIT(cfg->then_layer);
+            if ((state & mask) == mask) {
+                then_layer_state |= ZMK_KEYMAP_LAYER_BIT(cfg->then_layer);
             }
         }
 
         for (uint8_t layer = 0; layer <= max_then_layer; layer++) {
-            if ((BIT(layer) & then_layers) != 0U) {
-                if ((BIT(layer) & then_layer_state) != 0U) {
-                    conditional_layer_activate(layer);
+            if ((ZMK_KEYMAP_LAYER_BIT(layer) & then_layers) != 0U) {
+                if ((ZMK_KEYMAP_LAYER_BIT(layer) & then_layer_state) != 0U) {
+                    conditional_layer_activate(&state, layer);
                 } else {
-                    conditional_layer_deactivate(layer);
+                    conditional_layer_deactivate(&state, layer);
                 }
             }
         }
+
+        if (state == old_state) {
+            break;
+        }
+    }
+
+    return state;
+}
+
+static int layer_state_changed_listener(const zmk_event_t *ev) {
+    static bool conditional_layer_updates_needed;
+
+    conditional_layer_updates_needed = true;
+
+    // Semaphore ensures we don't re-enter the loop in the middle of doing update. The layer state
+    // change made below raises another event, which only flags that one more pass is needed.
+    if (k_sem_take(&conditional_layer_sem, K_NO_WAIT) < 0) {
+        return 0;
+    }
+
+    while (conditional_layer_updates_needed) {
+        conditional_layer_updates_needed = false;
+
+        zmk_keymap_layers_state_t state = zmk_keymap_layer_state();
+        zmk_keymap_layers_state_t new_state = conditional_layer_state(state);
+
+        if (new_state != state) {
+            zmk_keymap_layer_state_set(new_state);
+        }
     }
 
     k_sem_give(&conditional_layer_sem);
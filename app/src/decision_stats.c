@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/decision_stats.h>
+
+extern const struct zmk_decision_stats *__decision_stats_start[];
+extern const struct zmk_decision_stats *__decision_stats_end[];
+
+static inline size_t decision_stats_count() {
+    return __decision_stats_end - __decision_stats_start;
+}
+
+static uint8_t latency_bucket(int64_t latency_ms) {
+    if (latency_ms <= 0) {
+        return 0;
+    }
+    if (latency_ms >= BIT(ZMK_DECISION_STATS_BUCKETS - 2)) {
+        return ZMK_DECISION_STATS_BUCKETS - 1;
+    }
+    return 32 - __builtin_clz((uint32_t)latency_ms);
+}
+
+void zmk_decision_stats_record(const struct zmk_decision_stats *stats, uint8_t reason,
+                               int64_t latency_ms) {
+    if (stats == NULL || reason >= stats->reason_count) {
+        return;
+    }
+
+    stats->buckets[reason * ZMK_DECISION_STATS_BUCKETS + latency_bucket(latency_ms)]++;
+}
+
+const struct zmk_decision_stats *zmk_decision_stats_get(size_t index) {
+    return index < decision_stats_count() ? __decision_stats_start[index] : NULL;
+}
+
+void zmk_decision_stats_reset() {
+    for (size_t i = 0; i < decision_stats_count(); i++) {
+        const struct zmk_decision_stats *stats = __decision_stats_start[i];
+        memset(stats->buckets, 0,
+               stats->reason_count * ZMK_DECISION_STATS_BUCKETS * sizeof(stats->buckets[0]));
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_DECISION_STATS_SHELL)
+
+#include <stdio.h>
+#include <zephyr/shell/shell.h>
+
+static int cmd_decision_stats(const struct shell *sh, size_t argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        zmk_decision_stats_reset();
+        return 0;
+    }
+
+    shell_print(sh, "Latency buckets in ms: <1, then [2^(b-1), 2^b), the last one is >=%d",
+                (int)BIT(ZMK_DECISION_STATS_BUCKETS - 2));
+
+    const struct zmk_decision_stats *stats;
+    for (size_t i = 0; (stats = zmk_decision_stats_get(i)) != NULL; i++) {
+        for (uint8_t reason = 0; reason < stats->reason_count; reason++) {
+            const uint32_t *buckets = &stats->buckets[reason * ZMK_DECISION_STATS_BUCKETS];
+            char line[ZMK_DECISION_STATS_BUCKETS * 11 + 1];
+            size_t len = 0;
+            uint32_t total = 0;
+
+            for (int b = 0; b < ZMK_DECISION_STATS_BUCKETS; b++) {
+                len += snprintf(&line[len], sizeof(line) - len, " %u", buckets[b]);
+                total += buckets[b];
+            }
+
+            if (total > 0) {
+                shell_print(sh, "%-24s %-16s%s", stats->name, stats->reasons[reason], line);
+            }
+        }
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(decision_stats, NULL,
+                   "Print the hold-tap and combo decision latency histograms, or \"reset\" them",
+                   cmd_decision_stats);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_DECISION_STATS_SHELL) */
+
+#if IS_ENABLED(CONFIG_ZMK_DECISION_STATS_FEATURE_REPORT)
+
+#include <zephyr/sys/byteorder.h>
+
+#include <zmk/hid.h>
+#include <zmk/events/usb_feature_report.h>
+
+BUILD_ASSERT(sizeof(struct zmk_hid_decision_stats_report_body) ==
+                 ZMK_HID_DECISION_STATS_REPORT_BODY_SIZE,
+             "Decision stats report body does not match its HID descriptor");
+
+// Histogram returned by the next GET report. Each GET advances to the next one, wrapping around
+// after the last, and a SET report selects the histogram given by the host.
+static uint8_t report_index;
+static uint8_t report_reason;
+static struct zmk_hid_decision_stats_report stats_report = {
+    .report_id = DECISION_STATS_REPORT_ID,
+};
+
+static int handle_decision_stats_report(const struct zmk_usb_feature_report *ev) {
+    if (ev->direction == USB_REPORT_SET) {
+        if (*ev->len < sizeof(struct zmk_hid_decision_stats_report)) {
+            return -EINVAL;
+        }
+        struct zmk_hid_decision_stats_report *report =
+            (struct zmk_hid_decision_stats_report *)*ev->data;
+        report_index = report->body.index;
+        report_reason = report->body.reason;
+        return ZMK_EV_EVENT_HANDLED;
+    }
+
+    const struct zmk_decision_stats *stats = zmk_decision_stats_get(report_index);
+    if (stats == NULL || report_reason >= stats->reason_count) {
+        report_index = 0;
+        report_reason = 0;
+        stats = zmk_decision_stats_get(0);
+    }
+
+    memset(&stats_report.body, 0, sizeof(stats_report.body));
+    if (stats != NULL) {
+        stats_report.body.index = report_index;
+        stats_report.body.reason = report_reason;
+        stats_report.body.reason_count = stats->reason_count;
+        strncpy(stats_report.body.name, stats->name, sizeof(stats_report.body.name));
+        for (int b = 0; b < ZMK_DECISION_STATS_BUCKETS; b++) {
+            stats_report.body.buckets[b] = sys_cpu_to_le32(
+                stats->buckets[report_reason * ZMK_DECISION_STATS_BUCKETS + b]);
+        }
+
+        if (++report_reason == stats->reason_count) {
+            report_reason = 0;
+            report_index++;
+        }
+    }
+
+    *ev->data = (uint8_t *)&stats_report;
+    *ev->len = sizeof(stats_report);
+    return ZMK_EV_EVENT_HANDLED;
+}
+
+static int feature_report_listener(const zmk_event_t *eh) {
+    const struct zmk_usb_feature_report *ev = as_zmk_usb_feature_report(eh);
+
+    if (ev->id != DECISION_STATS_REPORT_ID) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    return handle_decision_stats_report(ev);
+}
+
+ZMK_LISTENER(decision_stats, feature_report_listener);
+ZMK_SUBSCRIPTION(decision_stats, zmk_usb_feature_report);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_DECISION_STATS_FEATURE_REPORT) */
@@ -8,6 +8,7 @@
 #include <zephyr/settings/settings.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include <zmk/ble.h>
 #include <zmk/endpoints.h>
@@ -120,8 +121,8 @@ struct zmk_endpoint_instance zmk_endpoints_selected(void) {
     return current_instance;
 }
 
-static int send_keyboard_report(void) {
-    struct zmk_hid_keyboard_report *keyboard_report = zmk_hid_get_keyboard_report();
+static int send_keyboard_report(uint8_t *report) {
+    struct zmk_hid_keyboard_report *keyboard_report = (struct zmk_hid_keyboard_report *)report;
 
     switch (current_instance.transport) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
@@ -149,8 +150,8 @@ static int send_keyboard_report(void) {
     }
 }
 
-static int send_consumer_report(void) {
-    struct zmk_hid_consumer_report *consumer_report = zmk_hid_get_consumer_report();
+static int send_consumer_report(uint8_t *report) {
+    struct zmk_hid_consumer_report *consumer_report = (struct zmk_hid_consumer_report *)report;
 
     switch (current_instance.transport) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
@@ -179,8 +180,9 @@ static int send_consumer_report(void) {
 }
 
 /* TODO- only USB is supported as a transport for now */
-static int send_gen_desktop_report(void) {
-    struct zmk_hid_gen_desktop_report *gen_desktop_report = zmk_hid_get_gen_desktop_report();
+static int send_gen_desktop_report(uint8_t *report) {
+    struct zmk_hid_gen_desktop_report *gen_desktop_report =
+        (struct zmk_hid_gen_desktop_report *)report;
 
     switch (current_instance.transport) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
@@ -199,24 +201,233 @@ static int send_gen_desktop_report(void) {
     }
 }
 
-int zmk_endpoints_send_report(uint16_t usage_page) {
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static int send_mouse_report(uint8_t *report) {
+    struct zmk_hid_mouse_report *mouse_report = (struct zmk_hid_mouse_report *)report;
+    int err;
 
-    LOG_DBG("usage page 0x%02X", usage_page);
-    switch (usage_page) {
-    case HID_USAGE_GD:
-        return send_gen_desktop_report();
+    switch (current_instance.transport) {
+#if IS_ENABLED(CONFIG_ZMK_USB)
+    case ZMK_TRANSPORT_USB:
+        err = zmk_usb_hid_send_report((uint8_t *)mouse_report, sizeof(*mouse_report));
+        break;
+#endif /* IS_ENABLED(CONFIG_ZMK_USB) */
 
-    case HID_USAGE_KEY:
-        return send_keyboard_report();
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+    case ZMK_TRANSPORT_BLE:
+        err = zmk_hog_send_mouse_report(&mouse_report->body);
+        break;
+#endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
+    default:
+        LOG_ERR("Unsupported endpoint transport %d", current_instance.transport);
+        return -ENOTSUP;
+    }
 
-    case HID_USAGE_CONSUMER:
-        return send_consumer_report();
+    // -EAGAIN only means the transport has no room yet, the mouse report is sent again later
+    if (err && err != -EAGAIN) {
+        LOG_ERR("FAILED TO SEND MOUSE REPORT: %d", err);
     }
+    return err;
+}
+#endif /* IS_ENABLED(CONFIG_ZMK_MOUSE) */
+
+static struct zmk_hid_keyboard_report keyboard_pending, keyboard_sent;
+static struct zmk_hid_consumer_report consumer_pending, consumer_sent;
+static struct zmk_hid_gen_desktop_report gen_desktop_pending, gen_desktop_sent;
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static struct zmk_hid_mouse_report mouse_sent;
+#endif
 
-    LOG_ERR("Unsupported usage page %d", usage_page);
-    return -ENOTSUP;
+static bool keyboard_toggles_back(const uint8_t *sent, const uint8_t *pending,
+                                  const uint8_t *current) {
+    return zmk_hid_keyboard_report_toggles_back(
+        &((const struct zmk_hid_keyboard_report *)sent)->body,
+        &((const struct zmk_hid_keyboard_report *)pending)->body,
+        &((const struct zmk_hid_keyboard_report *)current)->body);
 }
 
+static bool consumer_toggles_back(const uint8_t *sent, const uint8_t *pending,
+                                  const uint8_t *current) {
+    return zmk_hid_consumer_report_toggles_back(
+        &((const struct zmk_hid_consumer_report *)sent)->body,
+        &((const struct zmk_hid_consumer_report *)pending)->body,
+        &((const struct zmk_hid_consumer_report *)current)->body);
+}
+
+static bool gen_desktop_toggles_back(const uint8_t *sent, const uint8_t *pending,
+                                     const uint8_t *current) {
+    return zmk_hid_gen_desktop_report_toggles_back(
+        &((const struct zmk_hid_gen_desktop_report *)sent)->body,
+        &((const struct zmk_hid_gen_desktop_report *)pending)->body,
+        &((const struct zmk_hid_gen_desktop_report *)current)->body);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static bool mouse_has_motion(const uint8_t *report) {
+    return zmk_hid_mouse_report_has_motion(&((const struct zmk_hid_mouse_report *)report)->body);
+}
+#endif
+
+/**
+ * A report that is sent to the current endpoint.
+ *
+ * Inside a batch, requests to send the report only update the pending copy, which is sent once
+ * the batch ends. The pending copy is sent early if the next change would undo one of its changes
+ * (e.g. the same key is tapped twice), so the host sees every press and release. Outside a batch
+ * the report is sent right away. Either way, a report that equals the last one sent is dropped,
+ * without even comparing it when the HID module reports no change since it was last taken.
+ *
+ * Reports with motion are relative to the previous report, so they are always sent right away and
+ * are never dropped. They have no toggles_back and no pending copy.
+ */
+struct endpoint_report {
+    uint16_t usage_page;
+    size_t size;
+    uint8_t *(*get_current)(void);
+    bool (*toggles_back)(const uint8_t *sent, const uint8_t *pending, const uint8_t *current);
+    bool (*has_motion)(const uint8_t *report);
+    int (*send)(uint8_t *report);
+    uint8_t *pending;
+    uint8_t *sent;
+    // The pending copy holds changes that have not been sent yet
+    bool dirty;
+    // The sent copy holds the last report the current endpoint received
+    bool sent_valid;
+};
+
+static uint8_t *get_keyboard_report(void) { return (uint8_t *)zmk_hid_get_keyboard_report(); }
+static uint8_t *get_consumer_report(void) { return (uint8_t *)zmk_hid_get_consumer_report(); }
+static uint8_t *get_gen_desktop_report(void) { return (uint8_t *)zmk_hid_get_gen_desktop_report(); }
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static uint8_t *get_mouse_report(void) { return (uint8_t *)zmk_hid_get_mouse_report(); }
+#endif
+
+#define ENDPOINT_REPORT(page, type, name)                                                          \
+    {                                                                                              \
+        .usage_page = page, .size = sizeof(type), .get_current = get_##name##_report,              \
+        .toggles_back = name##_toggles_back, .send = send_##name##_report,                         \
+        .pending = (uint8_t *)&name##_pending, .sent = (uint8_t *)&name##_sent,                    \
+    }
+
+static struct endpoint_report endpoint_reports[] = {
+    ENDPOINT_REPORT(HID_USAGE_KEY, struct zmk_hid_keyboard_report, keyboard),
+    ENDPOINT_REPORT(HID_USAGE_CONSUMER, struct zmk_hid_consumer_report, consumer),
+    ENDPOINT_REPORT(HID_USAGE_GD, struct zmk_hid_gen_desktop_report, gen_desktop),
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    // Looked up by the page of its buttons, since the system control report has the GD page
+    {
+        .usage_page = HID_USAGE_BUTTON, .size = sizeof(struct zmk_hid_mouse_report),
+        .get_current = get_mouse_report, .has_motion = mouse_has_motion, .send = send_mouse_report,
+        .sent = (uint8_t *)&mouse_sent,
+    },
+#endif
+};
+
+static uint8_t batch_depth;
+
+static struct endpoint_report *find_endpoint_report(uint16_t usage_page) {
+    for (int i = 0; i < ARRAY_SIZE(endpoint_reports); i++) {
+        if (endpoint_reports[i].usage_page == usage_page) {
+            return &endpoint_reports[i];
+        }
+    }
+    return NULL;
+}
+
+static int send_endpoint_report(struct endpoint_report *report, uint8_t *body) {
+    report->dirty = false;
+
+    if (report->sent_valid && memcmp(body, report->sent, report->size) == 0 &&
+        (report->has_motion == NULL || !report->has_motion(body))) {
+        LOG_DBG("Skipping unchanged report for usage page 0x%02X", report->usage_page);
+        return 0;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MOCK)
+    int err = 0;
+#else
+    int err = report->send(body);
+#endif
+    if (err) {
+        // The host may be missing more than the last sent report, so don't skip the next one
+        report->sent_valid = false;
+        return err;
+    }
+
+    memcpy(report->sent, body, report->size);
+    report->sent_valid = true;
+    return 0;
+}
+
+void zmk_endpoints_batch_begin(void) { batch_depth++; }
+
+int zmk_endpoints_batch_end(void) {
+    if (batch_depth == 0 || --batch_depth > 0) {
+        return 0;
+    }
+
+    int ret = 0;
+    for (int i = 0; i < ARRAY_SIZE(endpoint_reports); i++) {
+        struct endpoint_report *report = &endpoint_reports[i];
+        if (report->dirty) {
+            int err = send_endpoint_report(report, report->pending);
+            if (err) {
+                ret = err;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static int update_endpoint_report(struct endpoint_report *report) {
+    uint8_t *current = report->get_current();
+    bool has_motion = report->has_motion != NULL && report->has_motion(current);
+
+    // Nothing changed since the current report was sent, or copied to the pending one
+    if (report->sent_valid && !report->dirty && !has_motion &&
+        !zmk_hid_report_changed(report->usage_page)) {
+        return 0;
+    }
+
+    if (batch_depth == 0 || report->toggles_back == NULL) {
+        int err = send_endpoint_report(report, current);
+        if (!err) {
+            zmk_hid_report_clear_changed(report->usage_page);
+        }
+        return err;
+    }
+
+    int err = 0;
+    if (report->dirty && report->toggles_back(report->sent, report->pending, current)) {
+        err = send_endpoint_report(report, report->pending);
+    }
+
+    memcpy(report->pending, current, report->size);
+    report->dirty = true;
+    zmk_hid_report_clear_changed(report->usage_page);
+
+    return err;
+}
+
+int zmk_endpoints_send_report(uint16_t usage_page) {
+
+    LOG_DBG("usage page 0x%02X", usage_page);
+    struct endpoint_report *report = find_endpoint_report(usage_page);
+    if (report == NULL) {
+        LOG_ERR("Unsupported usage page %d", usage_page);
+        return -ENOTSUP;
+    }
+
+    return update_endpoint_report(report);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+int zmk_endpoints_send_mouse_report() {
+    return update_endpoint_report(find_endpoint_report(HID_USAGE_BUTTON));
+}
+#endif
+
 #if IS_ENABLED(CONFIG_SETTINGS)
 
 static int endpoints_handle_set(const char *name, size_t len, settings_read_cb read_cb,
@@ -321,9 +532,23 @@ static int zmk_endpoints_init(const struct device *_arg) {
 static void disconnect_current_endpoint() {
     zmk_hid_keyboard_clear();
     zmk_hid_consumer_clear();
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    zmk_hid_mouse_clear();
+#endif
 
-    zmk_endpoints_send_report(HID_USAGE_KEY);
-    zmk_endpoints_send_report(HID_USAGE_CONSUMER);
+    // Sent right away, even inside a batch, so they reach the old endpoint. Changes still pending
+    // for it are dropped, since these clear them anyway.
+    send_endpoint_report(find_endpoint_report(HID_USAGE_KEY), get_keyboard_report());
+    send_endpoint_report(find_endpoint_report(HID_USAGE_CONSUMER), get_consumer_report());
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    send_endpoint_report(find_endpoint_report(HID_USAGE_BUTTON), get_mouse_report());
+#endif
+
+    for (int i = 0; i < ARRAY_SIZE(endpoint_reports); i++) {
+        endpoint_reports[i].dirty = false;
+        endpoint_reports[i].sent_valid = false;
+        memset(endpoint_reports[i].sent, 0, endpoint_reports[i].size);
+    }
 }
 
 static void update_current_endpoint(void) {
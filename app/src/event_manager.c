@@ -4,12 +4,15 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <string.h>
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/event_manager.h>
+#include <zmk/workqueue.h>
 
 extern struct zmk_event_type *__event_type_start[];
 extern struct zmk_event_type *__event_type_end[];
@@ -17,70 +20,428 @@ extern struct zmk_event_type *__event_type_end[];
 extern struct zmk_event_subscription __event_subscriptions_start[];
 extern struct zmk_event_subscription __event_subscriptions_end[];
 
+static atomic_t heap_fallbacks;
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+
+K_MEM_SLAB_DEFINE_STATIC(event_slab, CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCK_SIZE,
+                         CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCK_COUNT, sizeof(void *));
+
+static atomic_t slab_high_water;
+
+static inline bool is_slab_block(const void *ptr) {
+    const char *p = ptr;
+    return p >= event_slab.buffer &&
+           p < event_slab.buffer + (event_slab.num_blocks * event_slab.block_size);
+}
+
+static void update_slab_high_water(void) {
+    atomic_val_t used = k_mem_slab_num_used_get(&event_slab);
+    atomic_val_t high_water = atomic_get(&slab_high_water);
+
+    while (used > high_water && !atomic_cas(&slab_high_water, high_water, used)) {
+        high_water = atomic_get(&slab_high_water);
+    }
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB) */
+
+void *zmk_event_manager_alloc(size_t size) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    void *block;
+
+    if (size <= CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCK_SIZE &&
+        k_mem_slab_alloc(&event_slab, &block, K_NO_WAIT) == 0) {
+        update_slab_high_water();
+        return block;
+    }
+
+    LOG_WRN("Event slab exhausted, falling back to the heap");
+    atomic_inc(&heap_fallbacks);
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB) */
+
+    return k_malloc(size);
+}
+
+void zmk_event_manager_free(zmk_event_t *event) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    if (is_slab_block(event)) {
+        void *block = event;
+        k_mem_slab_free(&event_slab, &block);
+        return;
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB) */
+
+    k_free(event);
+}
+
+void zmk_event_manager_get_alloc_stats(struct zmk_event_manager_alloc_stats *stats) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    stats->slab_used = k_mem_slab_num_used_get(&event_slab);
+    stats->slab_high_water = atomic_get(&slab_high_water);
+#else
+    stats->slab_used = 0;
+    stats->slab_high_water = 0;
+#endif
+    stats->heap_fallbacks = atomic_get(&heap_fallbacks);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE),
+             "CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE must be a power of two");
+
+struct trace_slot {
+    // Set to the sequence number of the entry when a writer claims the slot, and to the sequence
+    // number plus one once the entry is complete.
+    atomic_t sequence;
+    struct zmk_event_trace_entry entry;
+};
+
+static struct trace_slot trace_buffer[CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE];
+// Sequence number of the next entry to be written. Writers claim a slot atomically, so
+// recording never takes a lock, even when events are raised from several threads.
+static atomic_t trace_head;
+
+static inline void trace_record(const struct zmk_event_type *event_type, uint8_t listener_index,
+                                uint32_t start, int result) {
+    uint32_t sequence = atomic_inc(&trace_head);
+    struct trace_slot *slot = &trace_buffer[sequence & (CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE - 1)];
+
+    atomic_set(&slot->sequence, sequence);
+    slot->entry.event_type = event_type;
+    slot->entry.cycles = k_cycle_get_32() - start;
+    slot->entry.listener_index = listener_index;
+    slot->entry.result = CLAMP(result, INT8_MIN, INT8_MAX);
+    atomic_set(&slot->sequence, sequence + 1);
+}
+
+int zmk_event_manager_trace_read(uint32_t *sequence, struct zmk_event_trace_entry *entries,
+                                 size_t len) {
+    uint32_t head = atomic_get(&trace_head);
+    uint32_t oldest =
+        head > CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE ? head - CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE : 0;
+    int count = 0;
+
+    if (*sequence < oldest || *sequence > head) {
+        *sequence = oldest;
+    }
+
+    while (*sequence < head && count < len) {
+        struct trace_slot *slot =
+            &trace_buffer[*sequence & (CONFIG_ZMK_EVENT_MANAGER_TRACE_SIZE - 1)];
+        uint32_t complete = *sequence + 1;
+        int32_t age = (uint32_t)atomic_get(&slot->sequence) - complete;
+
+        if (age < 0) {
+            // Still being written, read it next time
+            break;
+        }
+
+        entries[count] = slot->entry;
+        // Entries overwritten by a later one, before or while being copied, are skipped
+        if (age == 0 && (uint32_t)atomic_get(&slot->sequence) == complete) {
+            count++;
+        }
+        (*sequence)++;
+    }
+
+    return count;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE) */
+
+static inline int invoke_listener(zmk_event_t *event, uint8_t index) {
+    const struct zmk_listener *listener = __event_subscriptions_start[index].listener;
+
+    event->last_listener_index = index;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    const struct zmk_event_type *event_type = event->event;
+    uint32_t start = k_cycle_get_32();
+    int ret = listener->callback(event);
+    // A captured event may already have been released and freed, so don't dereference it.
+    trace_record(event_type, index, start, ret);
+    return ret;
+#else
+    return listener->callback(event);
+#endif
+}
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_ASYNC)
+
+static inline bool is_deferred(uint8_t index) {
+    return __event_subscriptions_start[index].listener->flags & ZMK_LISTENER_FLAG_DEFERRED;
+}
+
+struct deferred_event {
+    zmk_event_t *event;
+    // Subscription indexes of the deferred listeners to invoke, end excluded
+    uint8_t start;
+    uint8_t end;
+};
+
+K_MSGQ_DEFINE(deferred_events, sizeof(struct deferred_event),
+              CONFIG_ZMK_EVENT_MANAGER_ASYNC_QUEUE_SIZE, sizeof(zmk_event_t *));
+
+// Protects the pending copies of non-capturable events
+static struct k_spinlock pending_lock;
+
+// Invokes the deferred listeners of the event's type in the given range of indexes.
+static void dispatch_deferred(zmk_event_t *event, uint8_t start, uint8_t end) {
+    for (int i = start; i < end; i++) {
+        if (!is_deferred(i)) {
+            continue;
+        }
+
+        int ret = invoke_listener(event, i);
+        __ASSERT(ret != ZMK_EV_EVENT_CAPTURED, "Deferred listener captured %s event",
+                 event->event->name);
+        if (ret < 0) {
+            LOG_DBG("Deferred listener returned an error: %d", ret);
+        }
+    }
+}
+
+static void deferred_work_handler(struct k_work *work) {
+    struct deferred_event deferred;
+
+    while (k_msgq_get(&deferred_events, &deferred, K_NO_WAIT) == 0) {
+        struct zmk_event_subscribers *subscribers = deferred.event->event->subscribers;
+
+        k_spinlock_key_t key = k_spin_lock(&pending_lock);
+        if (subscribers->pending == deferred.event) {
+            subscribers->pending = NULL;
+        }
+        k_spin_unlock(&pending_lock, key);
+
+        dispatch_deferred(deferred.event, deferred.start, deferred.end);
+        zmk_event_manager_free(deferred.event);
+    }
+}
+
+K_WORK_DEFINE(deferred_work, deferred_work_handler);
+
+// Tries to merge a non-capturable event into the copy of the same type that is still waiting for
+// the deferred listeners. Latest value events are merged into the waiting copy, other state events
+// are only dropped if they are identical to it. Must be called with pending_lock held.
+static bool coalesce_pending(const zmk_event_t *event, uint8_t end) {
+    zmk_event_t *pending = event->event->subscribers->pending;
+    size_t payload_size = event->event->size - sizeof(zmk_event_t);
+
+    if (pending == NULL || pending->last_listener_index != end) {
+        return false;
+    }
+
+    if (event->event->flags & ZMK_EVENT_TYPE_FLAG_LATEST_VALUE) {
+        if (event->event->merge != NULL) {
+            event->event->merge(pending + 1, event + 1);
+        } else {
+            memcpy(pending + 1, event + 1, payload_size);
+        }
+        return true;
+    }
+
+    return memcmp(pending + 1, event + 1, payload_size) == 0;
+}
+
+// Hands an event over to the deferred listeners in [start, end). A capturable event that finished
+// its synchronous dispatch is handed over as is. Non-capturable events live on the raiser's stack,
+// and a capturable event that is about to be passed to a listener may be captured and freed, so
+// those are copied. Returns true if the event is now owned by the deferred queue.
+static bool defer_event(zmk_event_t *event, uint8_t start, uint8_t end, bool copy) {
+    struct zmk_event_subscribers *subscribers = event->event->subscribers;
+    bool non_capturable = event->event->flags & ZMK_EVENT_TYPE_FLAG_NON_CAPTURABLE;
+    struct deferred_event deferred = {.event = event, .start = start, .end = end};
+    k_spinlock_key_t key;
+
+    if (non_capturable) {
+        key = k_spin_lock(&pending_lock);
+        bool coalesced = coalesce_pending(event, end);
+        k_spin_unlock(&pending_lock, key);
+
+        if (coalesced) {
+            return false;
+        }
+    }
+
+    if (copy) {
+        deferred.event = zmk_event_manager_alloc(event->event->size);
+        if (deferred.event == NULL) {
+            dispatch_deferred(event, start, end);
+            return false;
+        }
+        memcpy(deferred.event, event, event->event->size);
+    }
+    deferred.event->last_listener_index = end;
+
+    // The pending copy is published under the same lock as the queue insertion, so the work
+    // handler can't dequeue it before it is recorded.
+    key = k_spin_lock(&pending_lock);
+    if (k_msgq_put(&deferred_events, &deferred, K_NO_WAIT) < 0) {
+        k_spin_unlock(&pending_lock, key);
+        LOG_WRN("Deferred event queue full, dispatching %s synchronously", event->event->name);
+        dispatch_deferred(deferred.event, start, end);
+        if (copy) {
+            zmk_event_manager_free(deferred.event);
+        }
+        return false;
+    }
+
+    if (non_capturable) {
+        subscribers->pending = deferred.event;
+    }
+    k_spin_unlock(&pending_lock, key);
+
+    k_work_submit_to_queue(zmk_workqueue_lowprio_work_q(), &deferred_work);
+    return true;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_ASYNC) */
+
 int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     int ret = 0;
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = start_index; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-        if (ev_sub->event_type != event->event) {
+    const struct zmk_event_subscribers *subscribers = event->event->subscribers;
+    bool non_capturable = event->event->flags & ZMK_EVENT_TYPE_FLAG_NON_CAPTURABLE;
+    // Deferred listeners only see the event up to the listener that stopped its dispatch
+    uint8_t end = subscribers->end;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_ASYNC)
+    // First deferred listener skipped since the event was last handed to the deferred listeners
+    int deferred_start = -1;
+#endif
+    for (int i = MAX(start_index, subscribers->start); i < subscribers->end; i++) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_ASYNC)
+        if (is_deferred(i)) {
+            if (deferred_start < 0) {
+                deferred_start = i;
+            }
             continue;
         }
-        event->last_listener_index = i;
-        ret = ev_sub->listener->callback(event);
+
+        // The listener may capture the event and free it without releasing it (e.g. combos), so
+        // the deferred listeners that come before it get a copy now.
+        if (deferred_start >= 0 && !non_capturable) {
+            defer_event(event, deferred_start, i, true);
+            deferred_start = -1;
+        }
+#endif
+        ret = invoke_listener(event, i);
         switch (ret) {
         case ZMK_EV_EVENT_BUBBLE:
             continue;
         case ZMK_EV_EVENT_HANDLED:
             LOG_DBG("Listener handled the event");
             ret = 0;
+            end = i;
             goto release;
         case ZMK_EV_EVENT_CAPTURED:
+            if (non_capturable) {
+                // The event lives on the raiser's stack, so it can't outlive this dispatch.
+                __ASSERT(false, "Listener captured non-capturable %s event", event->event->name);
+                LOG_ERR("Listener captured non-capturable %s event", event->event->name);
+                ret = -ENOTSUP;
+                end = i;
+                goto release;
+            }
             LOG_DBG("Listener captured the event");
             // Listeners are expected to free events they capture
             return 0;
         default:
             LOG_DBG("Listener returned an error: %d", ret);
+            end = i;
             goto release;
         }
     }
 
+    ret = 0;
+
 release:
-    k_free(event);
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_ASYNC)
+    // Deferred listeners before a listener that failed still get the event. Only a capturable
+    // event that finished its dispatch is handed over without a copy, and is then owned by the
+    // deferred queue.
+    if (deferred_start >= 0 && defer_event(event, deferred_start, end, non_capturable) &&
+        !non_capturable) {
+        return ret;
+    }
+#endif
+    if (!non_capturable) {
+        zmk_event_manager_free(event);
+    }
     return ret;
 }
 
 int zmk_event_manager_raise(zmk_event_t *event) { return zmk_event_manager_handle_from(event, 0); }
 
-int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+// Finds the subscription index of a listener for the type of the given event. Events re-raised
+// by a listener are almost always ones it captured (or is currently handling), in which case the
+// last listener index already points at it and no search is needed.
+static int find_listener_index(const zmk_event_t *event, const struct zmk_listener *listener) {
+    const struct zmk_event_subscribers *subscribers = event->event->subscribers;
+    uint8_t last = event->last_listener_index;
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i + 1);
-        }
+    if (last >= subscribers->start && last < subscribers->end &&
+        __event_subscriptions_start[last].listener == listener) {
+        return last;
     }
 
-    LOG_WRN("Unable to find where to raise this after event");
+    for (int i = subscribers->start; i < subscribers->end; i++) {
+        if (__event_subscriptions_start[i].listener == listener) {
+            return i;
+        }
+    }
 
     return -EINVAL;
 }
 
-int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i);
-        }
+int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
+    int index = find_listener_index(event, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find where to raise this after event");
+        return index;
     }
 
-    LOG_WRN("Unable to find where to raise this event");
+    return zmk_event_manager_handle_from(event, index + 1);
+}
 
-    return -EINVAL;
+int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener) {
+    int index = find_listener_index(event, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find where to raise this event");
+        return index;
+    }
+
+    return zmk_event_manager_handle_from(event, index);
 }
 
 int zmk_event_manager_release(zmk_event_t *event) {
     return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
 }
+
+static int zmk_event_manager_init(const struct device *_arg) {
+    size_t len = __event_subscriptions_end - __event_subscriptions_start;
+
+    // Listener indexes are stored in zmk_event_t.last_listener_index
+    if (len > UINT8_MAX) {
+        LOG_ERR("Too many event subscriptions (%d)", (int)len);
+        return -ENOMEM;
+    }
+
+    // The linker groups subscriptions by event type, so each type only needs its range recorded.
+    for (int i = 0; i < len; i++) {
+        struct zmk_event_subscribers *subscribers =
+            __event_subscriptions_start[i].event_type->subscribers;
+
+        if (subscribers->end == 0) {
+            subscribers->start = i;
+        } else if (subscribers->end != i) {
+            LOG_ERR("Subscriptions for %s are not contiguous",
+                    __event_subscriptions_start[i].event_type->name);
+            return -EINVAL;
+        }
+        subscribers->end = i + 1;
+    }
+
+    return 0;
+}
+
+SYS_INIT(zmk_event_manager_init, PRE_KERNEL_1, 0);
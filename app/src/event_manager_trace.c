@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/event_manager.h>
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE_SHELL)
+
+#include <zephyr/shell/shell.h>
+
+static int cmd_event_trace(const struct shell *sh, size_t argc, char **argv) {
+    struct zmk_event_trace_entry entries[8];
+    uint32_t sequence = 0;
+    int count;
+
+    shell_print(sh, "%10s %-32s %8s %8s %6s", "seq", "event", "listener", "us", "result");
+
+    while ((count = zmk_event_manager_trace_read(&sequence, entries, ARRAY_SIZE(entries))) > 0) {
+        for (int i = 0; i < count; i++) {
+            shell_print(sh, "%10u %-32s %8u %8u %6d", sequence - count + i,
+                        entries[i].event_type->name, entries[i].listener_index,
+                        k_cyc_to_us_floor32(entries[i].cycles), entries[i].result);
+        }
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(event_trace, NULL, "Dump the event manager dispatch trace", cmd_event_trace);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE_SHELL) */
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE_FEATURE_REPORT)
+
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <zmk/hid.h>
+#include <zmk/events/usb_feature_report.h>
+
+extern struct zmk_event_type *__event_type_start[];
+extern struct zmk_event_type *__event_type_end[];
+
+BUILD_ASSERT(sizeof(struct zmk_hid_event_trace_report_body) ==
+                 ZMK_HID_EVENT_TRACE_REPORT_BODY_SIZE,
+             "Event trace report body does not match its HID descriptor");
+
+// Sequence number of the next entry returned by a GET report. Each GET advances it, and a SET
+// report moves it to the sequence number given by the host.
+static uint32_t report_sequence;
+static struct zmk_hid_event_trace_report trace_report = {
+    .report_id = EVENT_TRACE_REPORT_ID,
+};
+
+static uint8_t event_type_index(const struct zmk_event_type *event_type) {
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        if (*type == event_type) {
+            return type - __event_type_start;
+        }
+    }
+
+    return UINT8_MAX;
+}
+
+static int handle_event_trace_report(const struct zmk_usb_feature_report *ev) {
+    struct zmk_event_trace_entry entries[ZMK_HID_EVENT_TRACE_REPORT_ENTRIES];
+    struct zmk_hid_event_trace_report *report;
+    int count;
+
+    if (ev->direction == USB_REPORT_SET) {
+        if (*ev->len < sizeof(struct zmk_hid_event_trace_report)) {
+            return -EINVAL;
+        }
+        report = (struct zmk_hid_event_trace_report *)*ev->data;
+        report_sequence = sys_le32_to_cpu(report->body.sequence);
+        return ZMK_EV_EVENT_HANDLED;
+    }
+
+    uint32_t sequence = report_sequence;
+    count = zmk_event_manager_trace_read(&sequence, entries, ARRAY_SIZE(entries));
+
+    trace_report.body.sequence = sys_cpu_to_le32(sequence - count);
+    trace_report.body.count = count;
+    memset(trace_report.body.entries, 0, sizeof(trace_report.body.entries));
+    for (int i = 0; i < count; i++) {
+        trace_report.body.entries[i] = (struct zmk_hid_event_trace_entry){
+            .event_type_index = event_type_index(entries[i].event_type),
+            .listener_index = entries[i].listener_index,
+            .result = entries[i].result,
+            .cycles = sys_cpu_to_le32(entries[i].cycles),
+        };
+    }
+    report_sequence = sequence;
+
+    *ev->data = (uint8_t *)&trace_report;
+    *ev->len = sizeof(trace_report);
+    return ZMK_EV_EVENT_HANDLED;
+}
+
+static int feature_report_listener(const zmk_event_t *eh) {
+    const struct zmk_usb_feature_report *ev = as_zmk_usb_feature_report(eh);
+
+    if (ev->id != EVENT_TRACE_REPORT_ID) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    return handle_event_trace_report(ev);
+}
+
+ZMK_LISTENER(event_trace, feature_report_listener);
+ZMK_SUBSCRIPTION(event_trace, zmk_usb_feature_report);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE_FEATURE_REPORT) */
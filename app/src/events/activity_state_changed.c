@@ -7,4 +7,4 @@
 #include <zephyr/kernel.h>
 #include <zmk/events/activity_state_changed.h>
 
-ZMK_EVENT_IMPL(zmk_activity_state_changed);
\ No newline at end of file
+ZMK_EVENT_IMPL_NON_CAPTURABLE(zmk_activity_state_changed);
\ No newline at end of file
@@ -7,4 +7,4 @@
 #include <zephyr/kernel.h>
 #include <zmk/events/battery_state_changed.h>
 
-ZMK_EVENT_IMPL(zmk_battery_state_changed);
\ No newline at end of file
+ZMK_EVENT_IMPL_LATEST_VALUE(zmk_battery_state_changed);
\ No newline at end of file
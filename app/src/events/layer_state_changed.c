@@ -7,4 +7,14 @@
 #include <zephyr/kernel.h>
 #include <zmk/events/layer_state_changed.h>
 
-ZMK_EVENT_IMPL(zmk_layer_state_changed);
\ No newline at end of file
+// The waiting event keeps its old state, so old_state to new_state still covers every change the
+// deferred listeners have not seen yet.
+static void merge_layer_state_changed(void *pending, const void *newer) {
+    struct zmk_layer_state_changed *ev = pending;
+    zmk_keymap_layers_state_t old_state = ev->old_state;
+
+    *ev = *(const struct zmk_layer_state_changed *)newer;
+    ev->old_state = old_state;
+}
+
+ZMK_EVENT_IMPL_LATEST_VALUE_MERGE(zmk_layer_state_changed, merge_layer_state_changed);
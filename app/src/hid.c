@@ -8,6 +8,9 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
 #include <zmk/hid.h>
 #include <dt-bindings/zmk/modifiers.h>
 
@@ -18,6 +21,10 @@ static struct zmk_hid_consumer_report consumer_report = {.report_id = 2, .body =
 
 static struct zmk_hid_gen_desktop_report gen_desktop_report = {.report_id = 3, .body = {.keys = 0}};
 
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static struct zmk_hid_mouse_report mouse_report = {.report_id = MOUSE_REPORT_ID};
+#endif
+
 // Keep track of how often a modifier was pressed.
 // Only release the modifier if the count is 0.
 static int explicit_modifier_counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
@@ -25,9 +32,22 @@ static zmk_mod_flags_t explicit_modifiers = 0;
 static zmk_mod_flags_t implicit_modifiers = 0;
 static zmk_mod_flags_t masked_modifiers = 0;
 
+#define KEYBOARD_CHANGED BIT(0)
+#define CONSUMER_CHANGED BIT(1)
+#define GEN_DESKTOP_CHANGED BIT(2)
+#define MOUSE_CHANGED BIT(3)
+
+// Reports that were modified since the endpoints last took them. A flag may be set although the
+// report ends up with the same content, but is never clear while the report differs.
+static uint8_t changed_reports;
+
 #define SET_MODIFIERS(mods)                                                                        \
     {                                                                                              \
-        keyboard_report.body.modifiers = (mods & ~masked_modifiers) | implicit_modifiers;          \
+        zmk_mod_flags_t new_mods = (mods & ~masked_modifiers) | implicit_modifiers;                \
+        if (keyboard_report.body.modifiers != new_mods) {                                          \
+            keyboard_report.body.modifiers = new_mods;                                             \
+            changed_reports |= KEYBOARD_CHANGED;                                                   \
+        }                                                                                          \
         LOG_DBG("Modifiers set to 0x%02X", keyboard_report.body.modifiers);                        \
     }
 
@@ -65,36 +85,64 @@ bool zmk_hid_mod_is_pressed(zmk_mod_t modifier) {
     return (zmk_hid_get_explicit_mods() & mod_flag) == mod_flag;
 }
 
+// Each modifier is counted separately, but the report is only updated once for the whole mask
 int zmk_hid_register_mods(zmk_mod_flags_t modifiers) {
-    int ret = 0;
-    for (zmk_mod_t i = 0; i < 8; i++) {
-        if (modifiers & (1 << i)) {
-            ret += zmk_hid_register_mod(i);
-        }
+    if (modifiers == 0) {
+        return 0;
     }
-    return ret;
+
+    for (uint32_t bits = modifiers; bits != 0; bits &= bits - 1) {
+        zmk_mod_t modifier = find_lsb_set(bits) - 1;
+        explicit_modifier_counts[modifier]++;
+        LOG_DBG("Modifier %d count %d", modifier, explicit_modifier_counts[modifier]);
+    }
+    explicit_modifiers |= modifiers;
+
+    zmk_mod_flags_t current = GET_MODIFIERS;
+    SET_MODIFIERS(explicit_modifiers);
+    return current == GET_MODIFIERS ? 0 : 1;
 }
 
 int zmk_hid_unregister_mods(zmk_mod_flags_t modifiers) {
-    int ret = 0;
-    for (zmk_mod_t i = 0; i < 8; i++) {
-        if (modifiers & (1 << i)) {
-            ret += zmk_hid_unregister_mod(i);
+    if (modifiers == 0) {
+        return 0;
+    }
+
+    for (uint32_t bits = modifiers; bits != 0; bits &= bits - 1) {
+        zmk_mod_t modifier = find_lsb_set(bits) - 1;
+        if (explicit_modifier_counts[modifier] <= 0) {
+            LOG_ERR("Tried to unregister modifier %d too often", modifier);
+            continue;
+        }
+        explicit_modifier_counts[modifier]--;
+        LOG_DBG("Modifier %d count: %d", modifier, explicit_modifier_counts[modifier]);
+        if (explicit_modifier_counts[modifier] == 0) {
+            LOG_DBG("Modifier %d released", modifier);
+            explicit_modifiers &= ~BIT(modifier);
         }
     }
 
-    return ret;
+    zmk_mod_flags_t current = GET_MODIFIERS;
+    SET_MODIFIERS(explicit_modifiers);
+    return current == GET_MODIFIERS ? 0 : 1;
 }
 
 #if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
 
-#define TOGGLE_KEYBOARD(code, val) WRITE_BIT(keyboard_report.body.keys[code / 8], code % 8, val)
+// The bitmap sits at an odd offset of the packed report, so a byte is the widest access that is
+// safe on every target. Each usage is a single masked read-modify-write of its byte.
+#define KEYBOARD_BYTE(usage) (keyboard_report.body.keys[(usage) >> 3])
+#define KEYBOARD_MASK(usage) ((uint8_t)BIT((usage)&0x7))
 
 static inline int select_keyboard_usage(zmk_key_t usage) {
     if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
         return -EINVAL;
     }
-    TOGGLE_KEYBOARD(usage, 1);
+    uint8_t old = KEYBOARD_BYTE(usage);
+    KEYBOARD_BYTE(usage) = old | KEYBOARD_MASK(usage);
+    if (KEYBOARD_BYTE(usage) != old) {
+        changed_reports |= KEYBOARD_CHANGED;
+    }
     return 0;
 }
 
@@ -102,7 +150,11 @@ static inline int deselect_keyboard_usage(zmk_key_t usage) {
     if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
         return -EINVAL;
     }
-    TOGGLE_KEYBOARD(usage, 0);
+    uint8_t old = KEYBOARD_BYTE(usage);
+    KEYBOARD_BYTE(usage) = old & ~KEYBOARD_MASK(usage);
+    if (KEYBOARD_BYTE(usage) != old) {
+        changed_reports |= KEYBOARD_CHANGED;
+    }
     return 0;
 }
 
@@ -110,39 +162,70 @@ static inline bool check_keyboard_usage(zmk_key_t usage) {
     if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
         return false;
     }
-    return keyboard_report.body.keys[usage / 8] & (1 << (usage % 8));
+    return (KEYBOARD_BYTE(usage) & KEYBOARD_MASK(usage)) != 0;
+}
+
+static inline void clear_keyboard_usages() {
+    memset(keyboard_report.body.keys, 0, sizeof(keyboard_report.body.keys));
 }
 
 #elif IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_HKRO)
 
-#define TOGGLE_KEYBOARD(match, val)                                                                \
-    for (int idx = 0; idx < CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE; idx++) {                          \
-        if (keyboard_report.body.keys[idx] != match) {                                             \
-            continue;                                                                              \
-        }                                                                                          \
-        keyboard_report.body.keys[idx] = val;                                                      \
-        if (val) {                                                                                 \
-            break;                                                                                 \
-        }                                                                                          \
-    }
+#define KEYBOARD_MAX_USAGE 0xFF
+
+BUILD_ASSERT(CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE <= 32,
+             "The free keyboard report slots must fit in a 32 bit mask");
+
+// Slot of each usage in the report, plus one so that zero means the usage is not in the report
+static uint8_t keyboard_usage_slots[KEYBOARD_MAX_USAGE + 1];
+static uint32_t keyboard_free_slots = BIT64_MASK(CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE);
 
 static inline int select_keyboard_usage(zmk_key_t usage) {
-    TOGGLE_KEYBOARD(0U, usage);
+    if (usage == 0 || usage > KEYBOARD_MAX_USAGE) {
+        return -EINVAL;
+    }
+    if (keyboard_usage_slots[usage] != 0) {
+        return 0;
+    }
+    if (keyboard_free_slots == 0) {
+        return -ENOMEM;
+    }
+
+    // Usages fill the lowest free slot, like hosts expect from a boot keyboard
+    uint8_t slot = find_lsb_set(keyboard_free_slots) - 1;
+    keyboard_free_slots &= ~BIT(slot);
+    keyboard_usage_slots[usage] = slot + 1;
+    keyboard_report.body.keys[slot] = usage;
+    changed_reports |= KEYBOARD_CHANGED;
     return 0;
 }
 
 static inline int deselect_keyboard_usage(zmk_key_t usage) {
-    TOGGLE_KEYBOARD(usage, 0U);
+    if (usage == 0 || usage > KEYBOARD_MAX_USAGE) {
+        return -EINVAL;
+    }
+    if (keyboard_usage_slots[usage] == 0) {
+        return 0;
+    }
+
+    uint8_t slot = keyboard_usage_slots[usage] - 1;
+    keyboard_usage_slots[usage] = 0;
+    keyboard_free_slots |= BIT(slot);
+    keyboard_report.body.keys[slot] = 0;
+    changed_reports |= KEYBOARD_CHANGED;
     return 0;
 }
 
-static inline int check_keyboard_usage(zmk_key_t usage) {
+static inline bool check_keyboard_usage(zmk_key_t usage) {
+    return usage != 0 && usage <= KEYBOARD_MAX_USAGE && keyboard_usage_slots[usage] != 0;
+}
+
+static inline void clear_keyboard_usages() {
     for (int idx = 0; idx < CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE; idx++) {
-        if (keyboard_report.body.keys[idx] == usage) {
-            return true;
-        }
+        keyboard_usage_slots[keyboard_report.body.keys[idx]] = 0;
     }
-    return false;
+    keyboard_free_slots = BIT64_MASK(CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE);
+    memset(keyboard_report.body.keys, 0, sizeof(keyboard_report.body.keys));
 }
 
 #else
@@ -157,12 +240,17 @@ static inline int check_keyboard_usage(zmk_key_t usage) {
             continue;                                                                              \
         }                                                                                          \
         consumer_report.body.keys[idx] = val;                                                      \
+        changed_reports |= CONSUMER_CHANGED;                                                       \
         if (val) {                                                                                 \
             break;                                                                                 \
         }                                                                                          \
     }
 
-#define TOGGLE_GEN_DESKTOP(key) gen_desktop_report.body.keys ^= BIT((key - HID_USAGE_GD_SYSTEM_POWER_DOWN))
+#define TOGGLE_GEN_DESKTOP(key)                                                                    \
+    {                                                                                              \
+        gen_desktop_report.body.keys ^= BIT((key - HID_USAGE_GD_SYSTEM_POWER_DOWN));               \
+        changed_reports |= GEN_DESKTOP_CHANGED;                                                    \
+    }
 
 
 int zmk_hid_implicit_modifiers_press(zmk_mod_flags_t new_implicit_modifiers) {
@@ -216,7 +304,11 @@ bool zmk_hid_keyboard_is_pressed(zmk_key_t code) {
     return check_keyboard_usage(code);
 }
 
-void zmk_hid_keyboard_clear() { memset(&keyboard_report.body, 0, sizeof(keyboard_report.body)); }
+void zmk_hid_keyboard_clear() {
+    clear_keyboard_usages();
+    keyboard_report.body.modifiers = 0;
+    changed_reports |= KEYBOARD_CHANGED;
+}
 
 int zmk_hid_consumer_press(zmk_key_t code) {
     TOGGLE_CONSUMER(0U, code);
@@ -228,7 +320,10 @@ int zmk_hid_consumer_release(zmk_key_t code) {
     return 0;
 };
 
-void zmk_hid_consumer_clear() { memset(&consumer_report.body, 0, sizeof(consumer_report.body)); }
+void zmk_hid_consumer_clear() {
+    memset(&consumer_report.body, 0, sizeof(consumer_report.body));
+    changed_reports |= CONSUMER_CHANGED;
+}
 
 bool zmk_hid_consumer_is_pressed(zmk_key_t key) {
     for (int idx = 0; idx < CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE; idx++) {
@@ -294,3 +389,145 @@ struct zmk_hid_consumer_report *zmk_hid_get_consumer_report() {
 struct zmk_hid_gen_desktop_report *zmk_hid_get_gen_desktop_report() {
     return &gen_desktop_report;
 }
+
+static uint8_t changed_flag(uint16_t usage_page) {
+    switch (usage_page) {
+    case HID_USAGE_KEY:
+        return KEYBOARD_CHANGED;
+    case HID_USAGE_CONSUMER:
+        return CONSUMER_CHANGED;
+    case HID_USAGE_GD:
+        return GEN_DESKTOP_CHANGED;
+    case HID_USAGE_BUTTON:
+        return MOUSE_CHANGED;
+    }
+    return 0;
+}
+
+bool zmk_hid_report_changed(uint16_t usage_page) {
+    uint8_t flag = changed_flag(usage_page);
+    // Reports without a flag are assumed to always change
+    return flag == 0 || (changed_reports & flag) != 0;
+}
+
+void zmk_hid_report_clear_changed(uint16_t usage_page) {
+    changed_reports &= ~changed_flag(usage_page);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+
+void zmk_hid_mouse_buttons_press(zmk_mouse_button_flags_t buttons) {
+    if ((mouse_report.body.buttons & buttons) != buttons) {
+        mouse_report.body.buttons |= buttons;
+        changed_reports |= MOUSE_CHANGED;
+    }
+}
+
+void zmk_hid_mouse_buttons_release(zmk_mouse_button_flags_t buttons) {
+    if ((mouse_report.body.buttons & buttons) != 0) {
+        mouse_report.body.buttons &= ~buttons;
+        changed_reports |= MOUSE_CHANGED;
+    }
+}
+
+void zmk_hid_mouse_movement_set(int16_t x, int16_t y) {
+    mouse_report.body.d_x = sys_cpu_to_le16(x);
+    mouse_report.body.d_y = sys_cpu_to_le16(y);
+    changed_reports |= MOUSE_CHANGED;
+}
+
+void zmk_hid_mouse_scroll_set(int8_t wheel, int8_t pan) {
+    mouse_report.body.d_wheel = wheel;
+    mouse_report.body.d_pan = pan;
+    changed_reports |= MOUSE_CHANGED;
+}
+
+void zmk_hid_mouse_clear() {
+    memset(&mouse_report.body, 0, sizeof(mouse_report.body));
+    changed_reports |= MOUSE_CHANGED;
+}
+
+bool zmk_hid_mouse_report_has_motion(const struct zmk_hid_mouse_report_body *body) {
+    return body->d_x != 0 || body->d_y != 0 || body->d_wheel != 0 || body->d_pan != 0;
+}
+
+struct zmk_hid_mouse_report *zmk_hid_get_mouse_report() {
+    return &mouse_report;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_MOUSE) */
+
+// Whether a bit that was changed by the pending report is changed back by the current one.
+static bool bits_toggle_back(const uint8_t *sent, const uint8_t *pending, const uint8_t *current,
+                             size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if ((pending[i] ^ sent[i]) & (current[i] ^ pending[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool usage_array_contains(const uint8_t *keys, size_t len, size_t width,
+                                 const uint8_t *usage) {
+    for (size_t i = 0; i < len; i += width) {
+        if (memcmp(&keys[i], usage, width) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a usage that was added to or removed from a report holding an array of usages by the
+// pending report is removed or added back by the current one. A usage may move to another slot of
+// the array, so this compares sets of usages rather than bytes.
+static bool usage_array_toggles_back(const uint8_t *sent, const uint8_t *pending,
+                                     const uint8_t *current, size_t len, size_t width) {
+    static const uint8_t no_usage[sizeof(uint32_t)];
+
+    for (size_t i = 0; i < len; i += width) {
+        if (memcmp(&pending[i], no_usage, width) != 0 &&
+            !usage_array_contains(sent, len, width, &pending[i]) &&
+            !usage_array_contains(current, len, width, &pending[i])) {
+            return true;
+        }
+        if (memcmp(&sent[i], no_usage, width) != 0 &&
+            !usage_array_contains(pending, len, width, &sent[i]) &&
+            usage_array_contains(current, len, width, &sent[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool zmk_hid_keyboard_report_toggles_back(const struct zmk_hid_keyboard_report_body *sent,
+                                          const struct zmk_hid_keyboard_report_body *pending,
+                                          const struct zmk_hid_keyboard_report_body *current) {
+    if (bits_toggle_back(&sent->modifiers, &pending->modifiers, &current->modifiers,
+                         sizeof(sent->modifiers))) {
+        return true;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
+    return bits_toggle_back(sent->keys, pending->keys, current->keys, sizeof(sent->keys));
+#else
+    return usage_array_toggles_back(sent->keys, pending->keys, current->keys, sizeof(sent->keys),
+                                    sizeof(sent->keys[0]));
+#endif
+}
+
+bool zmk_hid_consumer_report_toggles_back(const struct zmk_hid_consumer_report_body *sent,
+                                          const struct zmk_hid_consumer_report_body *pending,
+                                          const struct zmk_hid_consumer_report_body *current) {
+    return usage_array_toggles_back((const uint8_t *)sent, (const uint8_t *)pending,
+                                    (const uint8_t *)current, sizeof(sent->keys),
+                                    sizeof(sent->keys[0]));
+}
+
+bool zmk_hid_gen_desktop_report_toggles_back(
+    const struct zmk_hid_gen_desktop_report_body *sent,
+    const struct zmk_hid_gen_desktop_report_body *pending,
+    const struct zmk_hid_gen_desktop_report_body *current) {
+    return bits_toggle_back((const uint8_t *)sent, (const uint8_t *)pending,
+                            (const uint8_t *)current, sizeof(*sent));
+}
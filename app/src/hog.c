@@ -12,6 +12,7 @@
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
 
 #include <zmk/ble.h>
@@ -56,6 +57,13 @@ static struct hids_report consumer_input = {
     .type = HIDS_INPUT,
 };
 
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static struct hids_report mouse_input = {
+    .id = MOUSE_REPORT_ID,
+    .type = HIDS_INPUT,
+};
+#endif
+
 static bool host_requests_notification = false;
 static uint8_t ctrl_point;
 // static uint8_t proto_mode;
@@ -93,6 +101,15 @@ static ssize_t read_hids_consumer_input_report(struct bt_conn *conn,
                              sizeof(struct zmk_hid_consumer_report_body));
 }
 
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static ssize_t read_hids_mouse_input_report(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                            void *buf, uint16_t len, uint16_t offset) {
+    struct zmk_hid_mouse_report_body *report_body = &zmk_hid_get_mouse_report()->body;
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, report_body,
+                             sizeof(struct zmk_hid_mouse_report_body));
+}
+#endif
+
 // static ssize_t write_proto_mode(struct bt_conn *conn,
 //                                 const struct bt_gatt_attr *attr,
 //                                 const void *buf, uint16_t len, uint16_t offset,
@@ -139,6 +156,16 @@ BT_GATT_SERVICE_DEFINE(
     BT_GATT_CCC(input_ccc_changed, BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
     BT_GATT_DESCRIPTOR(BT_UUID_HIDS_REPORT_REF, BT_GATT_PERM_READ_ENCRYPT, read_hids_report_ref,
                        NULL, &consumer_input),
+    COND_CODE_1(IS_ENABLED(CONFIG_ZMK_MOUSE),
+                (BT_GATT_CHARACTERISTIC(BT_UUID_HIDS_REPORT,
+                                        BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                                        BT_GATT_PERM_READ_ENCRYPT, read_hids_mouse_input_report,
+                                        NULL, NULL),
+                 BT_GATT_CCC(input_ccc_changed,
+                             BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
+                 BT_GATT_DESCRIPTOR(BT_UUID_HIDS_REPORT_REF, BT_GATT_PERM_READ_ENCRYPT,
+                                    read_hids_report_ref, NULL, &mouse_input), ),
+                ())
     BT_GATT_CHARACTERISTIC(BT_UUID_HIDS_CTRL_POINT, BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                            BT_GATT_PERM_WRITE, NULL, write_ctrl_point, &ctrl_point));
 
@@ -161,111 +188,282 @@ K_THREAD_STACK_DEFINE(hog_q_stack, CONFIG_ZMK_BLE_THREAD_STACK_SIZE);
 
 struct k_work_q hog_work_q;
 
-K_MSGQ_DEFINE(zmk_hog_keyboard_msgq, sizeof(struct zmk_hid_keyboard_report_body),
-              CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE, 4);
+// Notifications handed to the stack but not sent yet. Each one holds a controller buffer, so no
+// more than that are handed over at a time, and the rest wait in the queues below where they can
+// still be merged.
+#define MAX_NOTIFY_IN_FLIGHT CONFIG_BT_BUF_ACL_TX_COUNT
 
-void send_keyboard_report_callback(struct k_work *work) {
-    struct zmk_hid_keyboard_report_body report;
+// Time to wait before retrying a notification that could not get a buffer
+#define NOTIFY_RETRY_MS 5
 
-    while (k_msgq_get(&zmk_hog_keyboard_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
-        }
+// Notifications in flight on each connection, by connection index. The notifications of a link
+// that drops never complete, so its count is reset when it disconnects.
+static atomic_t notify_in_flight[CONFIG_BT_MAX_CONN];
 
-        struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[5],
-            .data = &report,
-            .len = sizeof(report),
-        };
+/**
+ * Reports of one type that wait to be notified.
+ *
+ * While a report is queued, the next report of the same type replaces it, unless that would undo
+ * a change the queued report makes (see zmk_hid_keyboard_report_toggles_back()), or a report of
+ * another type was queued in between. So a congested link sends fewer reports, but every press and
+ * release still reaches the host, in order.
+ *
+ * Mouse reports carry relative motion, so they never replace each other. Their toggles_back is
+ * NULL, and a mouse report that finds its queue full is refused instead.
+ */
+struct hog_report_queue {
+    uint8_t attr_index;
+    uint8_t size;
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+    // depth reports of size bytes each
+    uint8_t *reports;
+    // Sequence numbers of the queued reports, to notify reports of all types in order
+    uint32_t *seqs;
+    // Last report handed to the stack
+    uint8_t *last_sent;
+    bool (*toggles_back)(const uint8_t *sent, const uint8_t *pending, const uint8_t *current);
+};
 
-        int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err) {
-            LOG_ERR("Error notifying %d", err);
-        }
+static bool keyboard_toggles_back(const uint8_t *sent, const uint8_t *pending,
+                                  const uint8_t *current) {
+    return zmk_hid_keyboard_report_toggles_back(
+        (const struct zmk_hid_keyboard_report_body *)sent,
+        (const struct zmk_hid_keyboard_report_body *)pending,
+        (const struct zmk_hid_keyboard_report_body *)current);
+}
+
+static bool consumer_toggles_back(const uint8_t *sent, const uint8_t *pending,
+                                  const uint8_t *current) {
+    return zmk_hid_consumer_report_toggles_back(
+        (const struct zmk_hid_consumer_report_body *)sent,
+        (const struct zmk_hid_consumer_report_body *)pending,
+        (const struct zmk_hid_consumer_report_body *)current);
+}
 
-        bt_conn_unref(conn);
+#define HOG_REPORT_QUEUE(name, type, queue_size, index, toggles_back_fn)                          \
+    static uint8_t name##_reports[queue_size * sizeof(type)];                                      \
+    static uint32_t name##_seqs[queue_size];                                                       \
+    static type name##_last_sent;                                                                  \
+    static struct hog_report_queue name##_queue = {                                                \
+        .attr_index = index,                                                                       \
+        .size = sizeof(type),                                                                      \
+        .depth = queue_size,                                                                       \
+        .reports = name##_reports,                                                                 \
+        .seqs = name##_seqs,                                                                       \
+        .last_sent = (uint8_t *)&name##_last_sent,                                                 \
+        .toggles_back = toggles_back_fn,                                                           \
     }
+
+HOG_REPORT_QUEUE(keyboard, struct zmk_hid_keyboard_report_body,
+                 CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE, 5, keyboard_toggles_back);
+HOG_REPORT_QUEUE(consumer, struct zmk_hid_consumer_report_body,
+                 CONFIG_ZMK_BLE_CONSUMER_REPORT_QUEUE_SIZE, 10, consumer_toggles_back);
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+HOG_REPORT_QUEUE(mouse, struct zmk_hid_mouse_report_body, CONFIG_ZMK_BLE_MOUSE_REPORT_QUEUE_SIZE,
+                 14, NULL);
+#endif
+
+static struct hog_report_queue *const report_queues[] = {
+    &keyboard_queue,
+    &consumer_queue,
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    &mouse_queue,
+#endif
+};
+
+static uint32_t next_seq;
+static struct k_spinlock queue_lock;
+
+static inline uint8_t *queued_report(struct hog_report_queue *queue, uint8_t n) {
+    return &queue->reports[((queue->head + n) % queue->depth) * queue->size];
 }
 
-K_WORK_DEFINE(hog_keyboard_work, send_keyboard_report_callback);
+static int queue_report(struct hog_report_queue *queue, const uint8_t *report) {
+    int ret = 0;
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+    uint8_t *newest = queue->count > 0 ? queued_report(queue, queue->count - 1) : NULL;
+    const uint8_t *before_newest =
+        queue->count > 1 ? queued_report(queue, queue->count - 2) : queue->last_sent;
+
+    // Only the newest report of all queues is merged into, so the change still goes out after every
+    // report that was queued before it
+    if (newest != NULL && queue->toggles_back != NULL &&
+        queue->seqs[(queue->head + queue->count - 1) % queue->depth] == next_seq - 1 &&
+        !queue->toggles_back(before_newest, newest, report)) {
+        // Nothing is lost by replacing the newest report, which hasn't been sent yet
+        memcpy(newest, report, queue->size);
+    } else if (queue->count == queue->depth && queue->toggles_back == NULL) {
+        ret = -EAGAIN;
+    } else if (queue->count == queue->depth) {
+        LOG_WRN("HOG report queue full, replacing the newest report");
+        memcpy(newest, report, queue->size);
+        queue->seqs[(queue->head + queue->count - 1) % queue->depth] = next_seq++;
+    } else {
+        memcpy(queued_report(queue, queue->count), report, queue->size);
+        queue->seqs[(queue->head + queue->count) % queue->depth] = next_seq++;
+        queue->count++;
+    }
 
-int zmk_hog_send_keyboard_report(struct zmk_hid_keyboard_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_keyboard_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Keyboard message queue full, popping first message and queueing again");
-            struct zmk_hid_keyboard_report_body discarded_report;
-            k_msgq_get(&zmk_hog_keyboard_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_keyboard_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue keyboard report to send (%d)", err);
-            return err;
+    k_spin_unlock(&queue_lock, key);
+    return ret;
+}
+
+// Pops the oldest queued report of any type into buf. It counts as sent from now on, since it is
+// notified before any report that is queued later.
+static struct hog_report_queue *pop_report(uint8_t *buf) {
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
+    struct hog_report_queue *oldest = NULL;
+
+    for (int i = 0; i < ARRAY_SIZE(report_queues); i++) {
+        struct hog_report_queue *queue = report_queues[i];
+        if (queue->count > 0 &&
+            (oldest == NULL ||
+             (int32_t)(queue->seqs[queue->head] - oldest->seqs[oldest->head]) < 0)) {
+            oldest = queue;
         }
     }
 
-    k_work_submit_to_queue(&hog_work_q, &hog_keyboard_work);
+    if (oldest != NULL) {
+        memcpy(buf, queued_report(oldest, 0), oldest->size);
+        memcpy(oldest->last_sent, buf, oldest->size);
+        oldest->head = (oldest->head + 1) % oldest->depth;
+        oldest->count--;
+    }
+
+    k_spin_unlock(&queue_lock, key);
+    return oldest;
+}
+
+static void drop_queued_reports() {
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
 
-    return 0;
+    for (int i = 0; i < ARRAY_SIZE(report_queues); i++) {
+        report_queues[i]->count = 0;
+        memset(report_queues[i]->last_sent, 0, report_queues[i]->size);
+    }
+
+    k_spin_unlock(&queue_lock, key);
+}
+
+static void send_reports_callback(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(hog_send_work, send_reports_callback);
+
+static void notify_done(struct bt_conn *conn) {
+    atomic_t *in_flight = &notify_in_flight[bt_conn_index(conn)];
+    atomic_val_t count;
+
+    // A notification that completes after its link was reset must not count twice
+    do {
+        count = atomic_get(in_flight);
+    } while (count > 0 && !atomic_cas(in_flight, count, count - 1));
+}
+
+static void notify_sent(struct bt_conn *conn, void *user_data) {
+    notify_done(conn);
+    k_work_reschedule_for_queue(&hog_work_q, &hog_send_work, K_NO_WAIT);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason) {
+    atomic_set(&notify_in_flight[bt_conn_index(conn)], 0);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .disconnected = disconnected,
 };
 
-K_MSGQ_DEFINE(zmk_hog_consumer_msgq, sizeof(struct zmk_hid_consumer_report_body),
-              CONFIG_ZMK_BLE_CONSUMER_REPORT_QUEUE_SIZE, 4);
+// Report that could not get a buffer, notified before any queued report. Only used from the HOG
+// work queue.
+static struct hog_report_queue *retry_queue;
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+#define MOUSE_REPORT_BODY_SIZE sizeof(struct zmk_hid_mouse_report_body)
+#else
+#define MOUSE_REPORT_BODY_SIZE 0
+#endif
+static uint8_t retry_report[MAX(MAX(sizeof(struct zmk_hid_keyboard_report_body),
+                                    sizeof(struct zmk_hid_consumer_report_body)),
+                                MOUSE_REPORT_BODY_SIZE)];
+
+static void send_reports_callback(struct k_work *work) {
+    struct bt_conn *conn = destination_connection();
+    if (conn == NULL) {
+        // Reports for a host that is gone would be stale once it is back
+        retry_queue = NULL;
+        drop_queued_reports();
+        return;
+    }
 
-void send_consumer_report_callback(struct k_work *work) {
-    struct zmk_hid_consumer_report_body report;
+    atomic_t *in_flight = &notify_in_flight[bt_conn_index(conn)];
 
-    while (k_msgq_get(&zmk_hog_consumer_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
+    while (atomic_get(in_flight) < MAX_NOTIFY_IN_FLIGHT) {
+        struct hog_report_queue *queue = retry_queue;
+        retry_queue = NULL;
+        if (queue == NULL) {
+            queue = pop_report(retry_report);
+        }
+        if (queue == NULL) {
+            break;
         }
 
         struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[10],
-            .data = &report,
-            .len = sizeof(report),
+            .attr = &hog_svc.attrs[queue->attr_index],
+            .data = retry_report,
+            .len = queue->size,
+            .func = notify_sent,
         };
 
+        atomic_inc(in_flight);
         int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err) {
-            LOG_DBG("Error notifying %d", err);
+
+        if (err == -ENOMEM) {
+            // Out of buffers, try again once one is free or a little later
+            notify_done(conn);
+            retry_queue = queue;
+            k_work_reschedule_for_queue(&hog_work_q, &hog_send_work, K_MSEC(NOTIFY_RETRY_MS));
+            break;
         }
 
-        bt_conn_unref(conn);
+        if (err) {
+            notify_done(conn);
+            LOG_ERR("Error notifying %d", err);
+        }
     }
-};
 
-K_WORK_DEFINE(hog_consumer_work, send_consumer_report_callback);
+    bt_conn_unref(conn);
+}
 
-int zmk_hog_send_consumer_report(struct zmk_hid_consumer_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_consumer_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Consumer message queue full, popping first message and queueing again");
-            struct zmk_hid_consumer_report_body discarded_report;
-            k_msgq_get(&zmk_hog_consumer_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_consumer_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue consumer report to send (%d)", err);
-            return err;
-        }
-    }
+int zmk_hog_send_keyboard_report(struct zmk_hid_keyboard_report_body *report) {
+    queue_report(&keyboard_queue, (const uint8_t *)report);
+    k_work_reschedule_for_queue(&hog_work_q, &hog_send_work, K_NO_WAIT);
 
-    k_work_submit_to_queue(&hog_work_q, &hog_consumer_work);
+    return 0;
+};
+
+int zmk_hog_send_consumer_report(struct zmk_hid_consumer_report_body *report) {
+    queue_report(&consumer_queue, (const uint8_t *)report);
+    k_work_reschedule_for_queue(&hog_work_q, &hog_send_work, K_NO_WAIT);
 
     return 0;
 };
 
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+int zmk_hog_send_mouse_report(struct zmk_hid_mouse_report_body *report) {
+    int err = queue_report(&mouse_queue, (const uint8_t *)report);
+    k_work_reschedule_for_queue(&hog_work_q, &hog_send_work, K_NO_WAIT);
+
+    return err;
+}
+#endif
+
 int zmk_hog_init(const struct device *_arg) {
     static const struct k_work_queue_config queue_config = {.name = "HID Over GATT Send Work"};
     k_work_queue_start(&hog_work_q, hog_q_stack, K_THREAD_STACK_SIZEOF(hog_q_stack),
                        CONFIG_ZMK_BLE_THREAD_PRIORITY, &queue_config);
 
+    bt_conn_cb_register(&conn_callbacks);
+
     return 0;
 }
 
@@ -62,7 +62,16 @@ static uint8_t _zmk_keymap_layer_default = 0;
 // When a behavior handles a key position "down" event, we record the layer state
 // here so that even if that layer is deactivated before the "up", event, we
 // still send the release event to the behavior in that layer also.
-static uint32_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
+static zmk_keymap_layers_state_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
+
+// For the current layer state, the highest active layer of each position whose binding is not
+// transparent, so that presses don't have to walk down through the transparent ones. Kept up to
+// date as layers change, and rebuilt on the next press after the bindings change.
+static uint8_t zmk_keymap_effective_layer[ZMK_KEYMAP_LEN];
+static bool zmk_keymap_effective_layer_valid;
+
+// The layer each pressed position started at, so its release starts at the same binding.
+static uint8_t zmk_keymap_pressed_layer[ZMK_KEYMAP_LEN];
 
 struct zmk_behavior_binding zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
     DT_INST_FOREACH_CHILD(0, TRANSFORMED_LAYER)};
@@ -78,27 +87,116 @@ static struct zmk_behavior_binding zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN]
 
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
-static inline int set_layer_state(uint8_t layer, bool state) {
-    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
-        return -EINVAL;
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_transparent)
+#define TRANSPARENT_BEHAVIOR DEVICE_DT_GET(DT_INST(0, zmk_behavior_transparent))
+#else
+#define TRANSPARENT_BEHAVIOR NULL
+#endif
+
+static bool is_transparent(int layer, uint32_t position) {
+    const struct device *behavior = behavior_binding_get_device(&zmk_keymap[layer][position]);
+
+    // Positions without a behavior fall through to the next layer as well
+    return behavior == NULL || behavior == TRANSPARENT_BEHAVIOR;
+}
+
+static uint8_t find_effective_layer(uint32_t position, int top_layer,
+                                    zmk_keymap_layers_state_t state) {
+    for (int layer = top_layer; layer > _zmk_keymap_layer_default; layer--) {
+        if ((state & ZMK_KEYMAP_LAYER_BIT(layer)) && !is_transparent(layer, position)) {
+            return layer;
+        }
     }
 
-    // Default layer should *always* remain active
-    if (layer == _zmk_keymap_layer_default && !state) {
-        return 0;
+    return _zmk_keymap_layer_default;
+}
+
+static void update_effective_layers(zmk_keymap_layers_state_t activated,
+                                    zmk_keymap_layers_state_t deactivated) {
+    if (!zmk_keymap_effective_layer_valid) {
+        return;
     }
 
+    for (uint32_t position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        uint8_t layer = zmk_keymap_effective_layer[position];
+
+        if (deactivated & ZMK_KEYMAP_LAYER_BIT(layer)) {
+            layer = find_effective_layer(position, layer - 1, _zmk_keymap_layer_state);
+        }
+
+        // Only layers activated above the effective one can take over the position
+        zmk_keymap_layers_state_t above = activated & ~((ZMK_KEYMAP_LAYER_BIT(layer) << 1) - 1);
+        if (above) {
+            layer = MAX(layer, find_effective_layer(position, zmk_keymap_layers_highest(above),
+                                                    above));
+        }
+
+        zmk_keymap_effective_layer[position] = layer;
+    }
+}
+
+static uint8_t effective_layer(uint32_t position) {
+    // Built on first use, since behavior devices can only be looked up once they are initialized
+    if (!zmk_keymap_effective_layer_valid) {
+        for (uint32_t i = 0; i < ZMK_KEYMAP_LEN; i++) {
+            zmk_keymap_effective_layer[i] =
+                find_effective_layer(i, ZMK_KEYMAP_LAYERS_LEN - 1, _zmk_keymap_layer_state);
+        }
+        zmk_keymap_effective_layer_valid = true;
+    }
+
+    return zmk_keymap_effective_layer[position];
+}
+
+void zmk_keymap_bindings_changed() { zmk_keymap_effective_layer_valid = false; }
+
+#define ZMK_KEYMAP_LAYERS_MASK                                                                     \
+    ((zmk_keymap_layers_state_t)((ZMK_KEYMAP_LAYER_BIT(ZMK_KEYMAP_LAYERS_LEN - 1) << 1) - 1))
+
+BUILD_ASSERT(ZMK_KEYMAP_LAYERS_LEN <= sizeof(zmk_keymap_layers_state_t) * 8,
+             "Keymaps with more than 32 layers need CONFIG_ZMK_KEYMAP_WIDE_LAYER_STATE");
+
+// Applies any number of layer changes at once, raising a single layer state changed event.
+static int set_layer_state_mask(zmk_keymap_layers_state_t state) {
     zmk_keymap_layers_state_t old_state = _zmk_keymap_layer_state;
-    WRITE_BIT(_zmk_keymap_layer_state, layer, state);
+
+    // Default layer should *always* remain active
+    state = (state & ZMK_KEYMAP_LAYERS_MASK) |
+            (old_state & ZMK_KEYMAP_LAYER_BIT(_zmk_keymap_layer_default));
+
     // Don't send state changes unless there was an actual change
-    if (old_state != _zmk_keymap_layer_state) {
-        LOG_DBG("layer_changed: layer %d state %d", layer, state);
-        ZMK_EVENT_RAISE(create_layer_state_changed(layer, state));
+    if (old_state == state) {
+        return 0;
     }
 
+    _zmk_keymap_layer_state = state;
+    LOG_DBG("layer_changed: state 0x%08x -> 0x%08x", (uint32_t)old_state, (uint32_t)state);
+    update_effective_layers(state & ~old_state, old_state & ~state);
+    raise_layer_state_changed(old_state, state);
+
     return 0;
 }
 
+static inline int set_layer_state(uint8_t layer, bool state) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
+        return -EINVAL;
+    }
+
+    if (state) {
+        return set_layer_state_mask(_zmk_keymap_layer_state | ZMK_KEYMAP_LAYER_BIT(layer));
+    }
+
+    return set_layer_state_mask(_zmk_keymap_layer_state & ~ZMK_KEYMAP_LAYER_BIT(layer));
+}
+
+int zmk_keymap_layer_state_set(zmk_keymap_layers_state_t state) {
+    if (state & ~ZMK_KEYMAP_LAYERS_MASK) {
+        return -EINVAL;
+    }
+
+    return set_layer_state_mask(state);
+}
+
 uint8_t zmk_keymap_layer_default() { return _zmk_keymap_layer_default; }
 
 zmk_keymap_layers_state_t zmk_keymap_layer_state() { return _zmk_keymap_layer_state; }
@@ -106,7 +204,7 @@ zmk_keymap_layers_state_t zmk_keymap_layer_state() { return _zmk_keymap_layer_st
 bool zmk_keymap_layer_active_with_state(uint8_t layer, zmk_keymap_layers_state_t state_to_test) {
     // The default layer is assumed to be ALWAYS ACTIVE so we include an || here to ensure nobody
     // breaks up that assumption by accident
-    return (state_to_test & (BIT(layer))) == (BIT(layer)) || layer == _zmk_keymap_layer_default;
+    return (state_to_test & ZMK_KEYMAP_LAYER_BIT(layer)) || layer == _zmk_keymap_layer_default;
 };
 
 bool zmk_keymap_layer_active(uint8_t layer) {
@@ -114,12 +212,8 @@ bool zmk_keymap_layer_active(uint8_t layer) {
 };
 
 uint8_t zmk_keymap_highest_layer_active() {
-    for (uint8_t layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer > 0; layer--) {
-        if (zmk_keymap_layer_active(layer)) {
-            return layer;
-        }
-    }
-    return zmk_keymap_layer_default();
+    return zmk_keymap_layers_highest(_zmk_keymap_layer_state |
+                                     ZMK_KEYMAP_LAYER_BIT(_zmk_keymap_layer_default));
 }
 
 int zmk_keymap_layer_activate(uint8_t layer) { return set_layer_state(layer, true); };
@@ -135,17 +229,15 @@ int zmk_keymap_layer_toggle(uint8_t layer) {
 };
 
 int zmk_keymap_layer_to(uint8_t layer) {
-    for (int i = ZMK_KEYMAP_LAYERS_LEN - 1; i >= 0; i--) {
-        zmk_keymap_layer_deactivate(i);
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
+        return -EINVAL;
     }
 
-    zmk_keymap_layer_activate(layer);
-
-    return 0;
+    return set_layer_state_mask(ZMK_KEYMAP_LAYER_BIT(layer));
 }
 
 bool is_active_layer(uint8_t layer, zmk_keymap_layers_state_t layer_state) {
-    return (layer_state & BIT(layer)) == BIT(layer) || layer == _zmk_keymap_layer_default;
+    return (layer_state & ZMK_KEYMAP_LAYER_BIT(layer)) || layer == _zmk_keymap_layer_default;
 }
 
 const char *zmk_keymap_layer_label(uint8_t layer) {
@@ -167,10 +259,11 @@ int invoke_locally(struct zmk_behavior_binding *binding, struct zmk_behavior_bin
 
 int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position, bool pressed,
                                     int64_t timestamp) {
+    // Resolve the behavior device on the keymap entry itself, so it is only looked up once
+    const struct device *behavior = behavior_binding_get_device(&zmk_keymap[layer][position]);
     // We want to make a copy of this, since it may be converted from
     // relative to absolute before being invoked
     struct zmk_behavior_binding binding = zmk_keymap[layer][position];
-    const struct device *behavior;
     struct zmk_behavior_binding_event event = {
         .layer = layer,
         .position = position,
@@ -179,8 +272,6 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
 
     LOG_DBG("layer: %d position: %d, binding name: %s", layer, position, binding.behavior_dev);
 
-    behavior = device_get_binding(binding.behavior_dev);
-
     if (!behavior) {
         LOG_WRN("No behavior assigned to %d on layer %d", position, layer);
         return 1;
@@ -228,8 +319,11 @@ int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pr
                                       int64_t timestamp) {
     if (pressed) {
         zmk_keymap_active_behavior_layer[position] = _zmk_keymap_layer_state;
+        zmk_keymap_pressed_layer[position] = effective_layer(position);
     }
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
+    // Layers above the starting one are either inactive or transparent for this position
+    for (int layer = zmk_keymap_pressed_layer[position]; layer >= _zmk_keymap_layer_default;
+         layer--) {
         if (zmk_keymap_layer_active_with_state(layer, zmk_keymap_active_behavior_layer[position])) {
             int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
             if (ret > 0) {
@@ -259,7 +353,7 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
         LOG_DBG("layer: %d sensor_index: %d, binding name: %s", layer, sensor_index,
                 binding->behavior_dev);
 
-        const struct device *behavior = device_get_binding(binding->behavior_dev);
+        const struct device *behavior = behavior_binding_get_device(binding);
         if (!behavior) {
             LOG_DBG("No behavior assigned to %d on layer %d", sensor_index, layer);
             continue;
@@ -16,6 +16,14 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 
+// Only the central half of a split keyboard sends HID reports
+#define ZMK_KSCAN_BATCH_REPORTS                                                                    \
+    (!IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL))
+
+#if ZMK_KSCAN_BATCH_REPORTS
+#include <zmk/endpoints.h>
+#endif
+
 #define ZMK_KSCAN_EVENT_STATE_PRESSED 0
 #define ZMK_KSCAN_EVENT_STATE_RELEASED 1
 
@@ -45,6 +53,11 @@ static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t
 void zmk_kscan_process_msgq(struct k_work *item) {
     struct zmk_kscan_event ev;
 
+#if ZMK_KSCAN_BATCH_REPORTS
+    // Keys that changed in the same scan are reported to the host together
+    zmk_endpoints_batch_begin();
+#endif
+
     while (k_msgq_get(&zmk_kscan_msgq, &ev, K_NO_WAIT) == 0) {
         bool pressed = (ev.state == ZMK_KSCAN_EVENT_STATE_PRESSED);
         int32_t position = zmk_matrix_transform_row_column_to_position(ev.row, ev.column);
@@ -63,6 +76,10 @@ void zmk_kscan_process_msgq(struct k_work *item) {
                                                 .position = position,
                                                 .timestamp = k_uptime_get()}));
     }
+
+#if ZMK_KSCAN_BATCH_REPORTS
+    zmk_endpoints_batch_end();
+#endif
 }
 
 int zmk_kscan_init(const struct device *dev) {
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/mouse.h>
+#include <zmk/hid.h>
+#include <zmk/endpoints.h>
+
+#define MAX_MOTIONS 10
+#define MAX_UNSENT_BUTTONS 8
+
+struct active_motion {
+    uint32_t id;
+    // NULL if the slot is free
+    const struct zmk_mouse_motion_config *config;
+    int16_t speed_x;
+    int16_t speed_y;
+    uint32_t ticks;
+    // Distance covered up to the last tick. Each tick adds the distance covered since, so the
+    // rounding of one tick is made up for by the next one.
+    int64_t moved_x;
+    int64_t moved_y;
+};
+
+// Only used from the system work queue, like the behaviors that start and stop motions
+static struct active_motion motions[MAX_MOTIONS];
+
+// Motion that has not been sent yet. Pointing devices may add to it from any context.
+static struct {
+    int32_t x;
+    int32_t y;
+    int32_t wheel;
+    int32_t pan;
+} pending;
+
+// Button states that have not been sent yet, oldest first. Each is sent in a report of its own, so
+// a press and release made while the transport is busy still reach the host as a click.
+static zmk_mouse_button_flags_t unsent_buttons[MAX_UNSENT_BUTTONS];
+static size_t unsent_buttons_len;
+
+// The last report could not be queued by the transport, and is sent again on the next tick
+static bool retry;
+static bool ticking;
+static int64_t next_tick;
+
+static struct k_spinlock lock;
+
+static void mouse_tick(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(tick_work, mouse_tick);
+
+static inline bool has_pending_motion() {
+    return pending.x != 0 || pending.y != 0 || pending.wheel != 0 || pending.pan != 0;
+}
+
+// Called with the lock held. Ticks are scheduled at absolute times, so the motion of keys, which is
+// counted in ticks, doesn't drift when the work queue is late.
+static void start_ticking() {
+    if (ticking) {
+        return;
+    }
+
+    ticking = true;
+    next_tick = k_uptime_get() + CONFIG_ZMK_MOUSE_TICK_DURATION;
+    k_work_schedule(&tick_work, K_TIMEOUT_ABS_MS(next_tick));
+}
+
+// Sets the buttons of the HID report and returns the previous ones
+static zmk_mouse_button_flags_t set_hid_buttons(zmk_mouse_button_flags_t buttons) {
+    zmk_mouse_button_flags_t previous = zmk_hid_get_mouse_report()->body.buttons;
+    zmk_hid_mouse_buttons_release(~buttons);
+    zmk_hid_mouse_buttons_press(buttons);
+    return previous;
+}
+
+// Sends the buttons and as much of the pending motion as fits in one report. The rest stays
+// pending, as does all of it if the transport has no room for the report yet.
+static int send_mouse_report() {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int16_t x = CLAMP(pending.x, -INT16_MAX, INT16_MAX);
+    int16_t y = CLAMP(pending.y, -INT16_MAX, INT16_MAX);
+    int8_t wheel = CLAMP(pending.wheel, -INT8_MAX, INT8_MAX);
+    int8_t pan = CLAMP(pending.pan, -INT8_MAX, INT8_MAX);
+    k_spin_unlock(&lock, key);
+
+    zmk_hid_mouse_movement_set(x, y);
+    zmk_hid_mouse_scroll_set(wheel, pan);
+
+    LOG_DBG("buttons 0x%02X x %d y %d wheel %d pan %d",
+            zmk_hid_get_mouse_report()->body.buttons, x, y, wheel, pan);
+    int err = zmk_endpoints_send_mouse_report();
+
+    // Motion is relative, so it must only be in the report it was sent with
+    zmk_hid_mouse_movement_set(0, 0);
+    zmk_hid_mouse_scroll_set(0, 0);
+
+    key = k_spin_lock(&lock);
+    retry = err == -EAGAIN;
+    if (err == 0) {
+        pending.x -= x;
+        pending.y -= y;
+        pending.wheel -= wheel;
+        pending.pan -= pan;
+    } else if (!retry) {
+        // There is no endpoint to send the motion to
+        memset(&pending, 0, sizeof(pending));
+    }
+    k_spin_unlock(&lock, key);
+
+    return err;
+}
+
+// Sends the unsent button states, oldest first, or the current buttons if there are none. The HID
+// report keeps the current buttons, so each unsent state is only put in it while it is sent.
+static int flush_mouse_report() {
+    int err;
+
+    do {
+        zmk_mouse_button_flags_t current = zmk_hid_get_mouse_report()->body.buttons;
+        if (unsent_buttons_len > 0) {
+            set_hid_buttons(unsent_buttons[0]);
+        }
+        err = send_mouse_report();
+        set_hid_buttons(current);
+
+        if (err == -EAGAIN) {
+            break;
+        } else if (err != 0) {
+            // There is no endpoint to send the buttons to
+            unsent_buttons_len = 0;
+        } else if (unsent_buttons_len > 0) {
+            unsent_buttons_len--;
+            memmove(&unsent_buttons[0], &unsent_buttons[1],
+                    unsent_buttons_len * sizeof(unsent_buttons[0]));
+        }
+    } while (unsent_buttons_len > 0);
+
+    return err;
+}
+
+// Distance covered after elapsed_ms, which is the integral of the speed curve
+static int64_t motion_distance(const struct zmk_mouse_motion_config *config, int16_t speed,
+                               int64_t elapsed_ms) {
+    int64_t t = elapsed_ms - config->delay_ms;
+    int64_t ramp = config->time_to_max_speed_ms;
+    int64_t exponent = config->acceleration_exponent;
+
+    if (t <= 0) {
+        return 0;
+    }
+
+    if (ramp == 0) {
+        return speed * t / 1000;
+    }
+
+    if (t >= ramp) {
+        return speed * (ramp + (exponent + 1) * (t - ramp)) / ((exponent + 1) * 1000);
+    }
+
+    int64_t t_pow = t;
+    int64_t ramp_pow = 1;
+    for (int i = 0; i < exponent; i++) {
+        t_pow *= t;
+        ramp_pow *= ramp;
+    }
+
+    return speed * t_pow / ((exponent + 1) * ramp_pow * 1000);
+}
+
+static void mouse_tick(struct k_work *work) {
+    int32_t move_x = 0, move_y = 0, wheel = 0, pan = 0;
+    bool motion_active = false;
+
+    for (int i = 0; i < ARRAY_SIZE(motions); i++) {
+        struct active_motion *motion = &motions[i];
+        if (motion->config == NULL) {
+            continue;
+        }
+
+        motion_active = true;
+        int64_t elapsed = ++motion->ticks * CONFIG_ZMK_MOUSE_TICK_DURATION;
+        int64_t x = motion_distance(motion->config, motion->speed_x, elapsed);
+        int64_t y = motion_distance(motion->config, motion->speed_y, elapsed);
+
+        if (motion->config->type == ZMK_MOUSE_MOTION_SCROLL) {
+            pan += x - motion->moved_x;
+            wheel += y - motion->moved_y;
+        } else {
+            move_x += x - motion->moved_x;
+            move_y += y - motion->moved_y;
+        }
+
+        motion->moved_x = x;
+        motion->moved_y = y;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    pending.x += move_x;
+    pending.y += move_y;
+    pending.wheel += wheel;
+    pending.pan += pan;
+    bool flush = retry || has_pending_motion();
+    k_spin_unlock(&lock, key);
+
+    if (flush) {
+        flush_mouse_report();
+    }
+
+    // Motion that didn't fit in the report, or was added in the meantime, is sent on the next tick
+    key = k_spin_lock(&lock);
+    if (motion_active || retry || has_pending_motion()) {
+        next_tick += CONFIG_ZMK_MOUSE_TICK_DURATION;
+        k_work_schedule(&tick_work, K_TIMEOUT_ABS_MS(next_tick));
+    } else {
+        ticking = false;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+static int send_buttons() {
+    zmk_mouse_button_flags_t buttons = zmk_hid_get_mouse_report()->body.buttons;
+
+    if (unsent_buttons_len < ARRAY_SIZE(unsent_buttons)) {
+        unsent_buttons[unsent_buttons_len++] = buttons;
+    } else {
+        LOG_WRN("More than %d mouse button changes unsent, merging the newest", MAX_UNSENT_BUTTONS);
+        unsent_buttons[unsent_buttons_len - 1] = buttons;
+    }
+
+    int err = flush_mouse_report();
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (retry || has_pending_motion()) {
+        start_ticking();
+    }
+    k_spin_unlock(&lock, key);
+
+    return err;
+}
+
+int zmk_mouse_buttons_press(zmk_mouse_button_flags_t buttons) {
+    zmk_hid_mouse_buttons_press(buttons);
+    return send_buttons();
+}
+
+int zmk_mouse_buttons_release(zmk_mouse_button_flags_t buttons) {
+    zmk_hid_mouse_buttons_release(buttons);
+    return send_buttons();
+}
+
+void zmk_mouse_move(int32_t x, int32_t y) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    pending.x += x;
+    pending.y += y;
+    start_ticking();
+    k_spin_unlock(&lock, key);
+}
+
+void zmk_mouse_scroll(int32_t wheel, int32_t pan) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    pending.wheel += wheel;
+    pending.pan += pan;
+    start_ticking();
+    k_spin_unlock(&lock, key);
+}
+
+int zmk_mouse_motion_start(uint32_t id, const struct zmk_mouse_motion_config *config, int16_t x,
+                           int16_t y) {
+    for (int i = 0; i < ARRAY_SIZE(motions); i++) {
+        struct active_motion *motion = &motions[i];
+        if (motion->config != NULL) {
+            continue;
+        }
+
+        *motion = (struct active_motion){.id = id, .config = config, .speed_x = x, .speed_y = y};
+
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        start_ticking();
+        k_spin_unlock(&lock, key);
+        return 0;
+    }
+
+    LOG_WRN("More than %d mouse keys held, ignoring the new one", MAX_MOTIONS);
+    return -ENOMEM;
+}
+
+void zmk_mouse_motion_stop(uint32_t id) {
+    for (int i = 0; i < ARRAY_SIZE(motions); i++) {
+        if (motions[i].config != NULL && motions[i].id == id) {
+            motions[i].config = NULL;
+            return;
+        }
+    }
+}
@@ -16,6 +16,15 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/event_manager.h>
 #include <zmk/events/sensor_event.h>
 
+// Pointing sensors feed the mouse report, which only exists on the central
+#define HAS_POINTING                                                                               \
+    (IS_ENABLED(CONFIG_ZMK_MOUSE) &&                                                               \
+     (!IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)))
+
+#if HAS_POINTING
+#include <zmk/mouse.h>
+#endif
+
 #if ZMK_KEYMAP_HAS_SENSORS
 
 struct sensors_item_cfg {
@@ -40,7 +49,8 @@ struct sensors_item_cfg {
         .triggers_per_rotation =                                                                   \
             DT_PROP_OR(node, triggers_per_rotation,                                                \
                        DT_PROP_OR(ZMK_KEYMAP_SENSORS_NODE, triggers_per_rotation,                  \
-                                  CONFIG_ZMK_KEYMAP_SENSORS_DEFAULT_TRIGGERS_PER_ROTATION))        \
+                                  CONFIG_ZMK_KEYMAP_SENSORS_DEFAULT_TRIGGERS_PER_ROTATION)),       \
+        .pointing = DT_PROP(node, pointing)                                                        \
     }
 #define SENSOR_CHILD_DEFAULTS(idx, arg)                                                            \
     {                                                                                              \
@@ -79,6 +89,26 @@ static void trigger_sensor_data_for_position(uint32_t sensor_index) {
         return;
     }
 
+#if HAS_POINTING
+    if (item->config->pointing) {
+        struct sensor_value dx, dy;
+        err = sensor_channel_get(item->dev, SENSOR_CHAN_POS_DX, &dx);
+        if (!err) {
+            err = sensor_channel_get(item->dev, SENSOR_CHAN_POS_DY, &dy);
+        }
+
+        if (err) {
+            LOG_WRN("Failed to get motion from device %d", err);
+            return;
+        }
+
+        // Samples are added to the next mouse report rather than raised as events, so a device
+        // reporting faster than the host polls doesn't flood the event manager
+        zmk_mouse_move(dx.val1, dy.val1);
+        return;
+    }
+#endif
+
     struct sensor_value value;
     err = sensor_channel_get(item->dev, item->trigger.chan, &value);
 
@@ -132,6 +162,15 @@ static void zmk_sensors_init_item(uint8_t i) {
         return;
     }
 
+    if (sensors[i].config->pointing) {
+        if (!HAS_POINTING) {
+            LOG_WRN("Pointing sensor %d needs the mouse report, which is disabled", i);
+            return;
+        }
+
+        sensors[i].trigger.chan = SENSOR_CHAN_ALL;
+    }
+
     int err = sensor_trigger_set(sensors[i].dev, &sensors[i].trigger, zmk_sensors_trigger_handler);
     if (err) {
         LOG_WRN("Failed to set sensor trigger (%d)", err);
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <string.h>
 #include <zephyr/kernel.h>
 #include <zmk/matrix.h>
 #include <zmk/config.h>
@@ -59,6 +60,7 @@ static int keymap_record_to_binding(struct zmk_behavior_binding *out,
         return -EINVAL;
     }
     out->behavior_dev = (char *)behavior_map[in->behavior_id];
+    out->dev = NULL;
     out->param1 = in->param1;
     out->param2 = in->param2;
     return 0;
@@ -96,58 +98,193 @@ static int keymap_binding_to_record(struct zmk_keymap_record *out,
     return 0;
 }
 
+/*
+ * Keymap entries are stored as struct zmk_keymap_record. Firmware before
+ * CONFIG_FORMAT_RECORDS stored raw bindings, holding a pointer to the
+ * behavior label (and later also a device pointer), which are converted
+ * when they are loaded.
+ */
+#define CONFIG_FORMAT_RECORDS 2
+
+/* Stored format of the keymap entries. Outside of the key record IDs. */
+#define CONFIG_FORMAT_ID (0xB << 12)
+
+/* Record of a binding slot that holds no behavior */
+#define RECORD_NO_BEHAVIOR UINT32_MAX
+
+struct legacy_binding {
+    const char *behavior_dev;
+    uint32_t param1;
+    uint32_t param2;
+};
+
+struct legacy_binding_with_dev {
+    const char *behavior_dev;
+    const void *dev;
+    uint32_t param1;
+    uint32_t param2;
+};
+
+union stored_key {
+    struct zmk_keymap_record record;
+    struct legacy_binding legacy;
+    struct legacy_binding_with_dev legacy_with_dev;
+};
+
+/* Behavior ID of a label pointer from a previous build, or -EINVAL */
+static int legacy_behavior_id(const char *behavior_dev) {
+    for (uint32_t id = 0; id < ARRAY_SIZE(behavior_map); id++) {
+        if (behavior_map[id] != NULL && behavior_map[id] == behavior_dev) {
+            return id;
+        }
+    }
+    /* The label may have moved since the build that stored it */
+    for (uint32_t id = 0; id < ARRAY_SIZE(behavior_map); id++) {
+        if (behavior_map[id] != NULL && strcmp(behavior_dev, behavior_map[id]) == 0) {
+            return id;
+        }
+    }
+    return -EINVAL;
+}
+
+static int legacy_to_record(struct zmk_keymap_record *out, const char *behavior_dev,
+                            uint32_t param1, uint32_t param2) {
+    if (behavior_dev == NULL) {
+        out->behavior_id = RECORD_NO_BEHAVIOR;
+    } else {
+        int id = legacy_behavior_id(behavior_dev);
+        if (id < 0) {
+            return id;
+        }
+        out->behavior_id = id;
+    }
+    out->param1 = param1;
+    out->param2 = param2;
+    return 0;
+}
+
+/*
+ * Reads the key record stored for a binding slot, converting it from the
+ * format it was stored in.
+ * @retval -ENOENT if nothing is stored for the slot
+ * @retval -EINVAL if the stored entry can't be converted
+ */
+static int read_key_record(uint8_t layer, uint8_t key_off, bool legacy,
+                           struct zmk_keymap_record *out) {
+    union stored_key stored;
+    ssize_t rc = nvs_read(&config_fs, CONFIG_KEY_RECORD(layer, key_off), &stored, sizeof(stored));
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (!legacy) {
+        if (rc != sizeof(stored.record)) {
+            return -EINVAL;
+        }
+        *out = stored.record;
+    } else if (rc == sizeof(stored.legacy)) {
+        return legacy_to_record(out, stored.legacy.behavior_dev, stored.legacy.param1,
+                                stored.legacy.param2);
+    } else if (rc == sizeof(stored.legacy_with_dev)) {
+        return legacy_to_record(out, stored.legacy_with_dev.behavior_dev,
+                                stored.legacy_with_dev.param1, stored.legacy_with_dev.param2);
+    } else {
+        return -EINVAL;
+    }
+
+    if (out->behavior_id != RECORD_NO_BEHAVIOR &&
+        (out->behavior_id >= ARRAY_SIZE(behavior_map) || behavior_map[out->behavior_id] == NULL)) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int load_key_record(struct zmk_behavior_binding *out, struct zmk_keymap_record *in) {
+    if (in->behavior_id == RECORD_NO_BEHAVIOR) {
+        *out = (struct zmk_behavior_binding){0};
+        return 0;
+    }
+    return keymap_record_to_binding(out, in);
+}
+
+static int write_format(void) {
+    uint8_t format = CONFIG_FORMAT_RECORDS;
+    ssize_t rc = nvs_write(&config_fs, CONFIG_FORMAT_ID, &format, sizeof(format));
+    return rc < 0 ? rc : 0;
+}
+
+static int clear_key_records(void) {
+    for (uint8_t layer = 0; layer < CONFIG_ZMK_SETTINGS_KEYMAP_LAYERS; layer++) {
+        for (uint8_t key_off = 0; key_off < ZMK_KEYMAP_LEN; key_off++) {
+            int rc = nvs_delete(&config_fs, CONFIG_KEY_RECORD(layer, key_off));
+            if (rc < 0) {
+                LOG_ERR("Could not delete all keymap entries (%d)", rc);
+                return rc;
+            }
+        }
+    }
+    return write_format();
+}
+
 /* Loads all keymap settings from flash into RAM array */
 static int zmk_config_load(void)
 {
-    struct zmk_behavior_binding tmp;
-    int rc, id;
+    struct zmk_keymap_record record;
+    uint8_t format = 0;
     uint8_t layer, key_off;
+    int rc;
 
-    /* Read the first keymap entry into a temporary buffer, and verify
-     * it maps to a valid keymap. If not, clear the settings store.
-     */
-    rc = nvs_read(&config_fs, CONFIG_KEY_RECORD(0, 0), &tmp, sizeof(tmp));
-    if (rc != sizeof(tmp)) {
+    rc = nvs_read(&config_fs, CONFIG_FORMAT_ID, &format, sizeof(format));
+    if (rc < 0 && rc != -ENOENT) {
         return rc;
     }
-    for (id = 0; id < ARRAY_SIZE(behavior_map); id++) {
-        if (behavior_map[id] == tmp.behavior_dev) {
-            break;
-        }
+    if (format > CONFIG_FORMAT_RECORDS) {
+        LOG_WRN("Keymap in flash has unknown format %d, using default", format);
+        return clear_key_records();
     }
-    if (id == ARRAY_SIZE(behavior_map)) {
-        LOG_WRN("Keymap found in flash appears invalid, using default");
-        /* Clear all key entries in flash */
-        for (layer = 0; layer < CONFIG_ZMK_SETTINGS_KEYMAP_LAYERS; layer++) {
-            for (key_off = 0; key_off < ZMK_KEYMAP_LEN; key_off++) {
-                rc = nvs_delete(&config_fs, CONFIG_KEY_RECORD(layer, key_off));
-                if (rc < 0) {
-                    LOG_ERR("Could not delete all keymap entries (%d)", rc);
-                    return rc;
-                }
+    bool legacy = format < CONFIG_FORMAT_RECORDS;
+
+    /* Verify every entry before touching the keymap, so that an invalid
+     * keymap in flash leaves the default one intact.
+     */
+    for (layer = 0; layer < CONFIG_ZMK_SETTINGS_KEYMAP_LAYERS; layer++) {
+        for (key_off = 0; key_off < ZMK_KEYMAP_LEN; key_off++) {
+            rc = read_key_record(layer, key_off, legacy, &record);
+            if (rc == -ENOENT && layer == 0 && key_off == 0) {
+                LOG_DBG("No keymap stored in flash, using default");
+                return legacy ? write_format() : 0;
+            }
+            if (rc < 0) {
+                LOG_WRN("Keymap found in flash appears invalid at [%d, %d] (%d), using default",
+                        layer, key_off, rc);
+                return clear_key_records();
             }
         }
     }
 
-    /* We have valid keymap data. Read keymap data from NVS */
     for (layer = 0; layer < CONFIG_ZMK_SETTINGS_KEYMAP_LAYERS; layer++) {
         for (key_off = 0; key_off < ZMK_KEYMAP_LEN; key_off++) {
-            rc = nvs_read(&config_fs, CONFIG_KEY_RECORD(layer, key_off),
-                    &zmk_keymap[layer][key_off], sizeof(zmk_keymap[0][0]));
-            if (rc != sizeof(zmk_keymap[0][0])) {
-                LOG_ERR("Could not read key at [%d, %d] (%d)",
-                        layer, key_off, rc);
+            rc = read_key_record(layer, key_off, legacy, &record);
+            if (rc == 0) {
+                rc = load_key_record(&zmk_keymap[layer][key_off], &record);
+            }
+            if (rc < 0) {
+                LOG_ERR("Could not read key at [%d, %d] (%d)", layer, key_off, rc);
                 return rc;
             }
         }
     }
+
+    if (legacy) {
+        LOG_INF("Converting keymap in flash to key records");
+        return zmk_config_save_key_records();
+    }
     return 0;
 }
 
 /* Initialization function called from main() to setup config subsystem */
 int zmk_config_init(void) {
     int ret;
-    uint32_t id;
     struct flash_pages_info info;
 
     /* NVS filesystem is defined to occupy entire storage region */
@@ -171,38 +308,12 @@ int zmk_config_init(void) {
 
     /* Now that the filesystem is loaded, read in all key data */
     ret = zmk_config_load();
+    zmk_keymap_bindings_changed();
     if (ret < 0) {
         LOG_ERR("Could not load ZMK config data (%d)", ret);
         return ret;
     }
 
-    /* When all settings are loaded, we should make sure that the
-     * string pointers within behavior bindings are replaced with pointers
-     * into the constant string array we declared in this build.
-     */
-    for (uint8_t i = 0; i < CONFIG_ZMK_SETTINGS_KEYMAP_LAYERS; i++) {
-        for (uint8_t j = 0; j < ZMK_KEYMAP_LEN; j++) {
-            for (id = 0; id < ARRAY_SIZE(behavior_map); id++) {
-                if (strcmp(zmk_keymap[i][j].behavior_dev, behavior_map[id]) == 0) {
-                    if (zmk_keymap[i][j].behavior_dev != behavior_map[id]) {
-                        /* Set new pointer, store it back to NVS */
-                        zmk_keymap[i][j].behavior_dev = behavior_map[id];
-                        ret = nvs_write(&config_fs, CONFIG_KEY_RECORD(i, j),
-                                &zmk_keymap[i][j], sizeof(zmk_keymap[0][0]));
-                        if (ret != sizeof(zmk_keymap[0][0])) {
-                            LOG_ERR("Cannot write to NVS fs (%d)", ret);
-                            return ret;
-                        }
-                    }
-                    break;
-                }
-            }
-            if (id == ARRAY_SIZE(behavior_map)) {
-                return -EINVAL;
-            }
-        }
-    }
-
     return 0;
 }
 
@@ -229,7 +340,9 @@ int zmk_config_set_key_record(uint8_t layer_index, uint8_t key_index,
         return -EINVAL;
     }
     /* Convert record to binding */
-    return keymap_record_to_binding(&zmk_keymap[layer_index][key_index], record);
+    int ret = keymap_record_to_binding(&zmk_keymap[layer_index][key_index], record);
+    zmk_keymap_bindings_changed();
+    return ret;
 }
 
 int zmk_config_save_key_records(void)
@@ -240,14 +353,21 @@ int zmk_config_save_key_records(void)
     /* Save all key records using NVS */
     for (layer = 0; layer < CONFIG_ZMK_SETTINGS_KEYMAP_LAYERS; layer++) {
         for (key_off = 0; key_off < ZMK_KEYMAP_LEN; key_off++) {
+            struct zmk_keymap_record record = {.behavior_id = RECORD_NO_BEHAVIOR};
+            if (zmk_keymap[layer][key_off].behavior_dev != NULL) {
+                rc = keymap_binding_to_record(&record, &zmk_keymap[layer][key_off]);
+                if (rc < 0) {
+                    return rc;
+                }
+            }
             rc = nvs_write(&config_fs, CONFIG_KEY_RECORD(layer, key_off),
-                    &zmk_keymap[layer][key_off], sizeof(zmk_keymap[0][0]));
+                    &record, sizeof(record));
             /* Return code of 0 is fine here, indicates key was not changed */
             if (rc < 0) {
                 return rc;
             }
         }
     }
-    return 0;
+    return write_format();
 }
 
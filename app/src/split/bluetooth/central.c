@@ -20,6 +20,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/stdlib.h>
 #include <zmk/ble.h>
+#include <zmk/endpoints.h>
 #include <zmk/behavior.h>
 #include <zmk/sensors.h>
 #include <zmk/split/bluetooth/uuid.h>
@@ -61,10 +62,12 @@ K_MSGQ_DEFINE(peripheral_event_msgq, sizeof(struct zmk_position_state_changed),
 
 void peripheral_event_work_callback(struct k_work *work) {
     struct zmk_position_state_changed ev;
+    zmk_endpoints_batch_begin();
     while (k_msgq_get(&peripheral_event_msgq, &ev, K_NO_WAIT) == 0) {
         LOG_DBG("Trigger key position state change for %d", ev.position);
         ZMK_EVENT_RAISE(new_zmk_position_state_changed(ev));
     }
+    zmk_endpoints_batch_end();
 }
 
 K_WORK_DEFINE(peripheral_event_work, peripheral_event_work_callback);
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <dt-bindings/zmk/modifiers.h>
+#include <zmk/text_inject.h>
+#include <zmk/ble.h>
+#include <zmk/endpoints.h>
+#include <zmk/hid.h>
+#include <zmk/keys.h>
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_HKRO)
+#define MAX_FRAME_KEYS CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE
+#else
+// Only keys typed in ascending order of usage share an NKRO report, which rarely exceeds this
+#define MAX_FRAME_KEYS 8
+#endif
+
+// Keys waiting to be typed
+static uint32_t queue[CONFIG_ZMK_TEXT_INJECT_QUEUE_SIZE];
+static size_t queue_head;
+static size_t queue_len;
+
+// Keys pressed by the last report sent, in the order they were typed, and their modifiers
+static zmk_key_t frame_keys[MAX_FRAME_KEYS];
+static size_t frame_len;
+static zmk_mod_flags_t frame_mods;
+
+static bool injecting;
+static int64_t next_frame;
+
+static void inject_frame(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(frame_work, inject_frame);
+
+static bool can_type(uint32_t keycode) {
+    uint8_t page = ZMK_HID_USAGE_PAGE(keycode);
+    zmk_key_t usage = ZMK_HID_USAGE_ID(keycode);
+
+    if ((page != 0 && page != HID_USAGE_KEY) || usage == 0 || is_mod(HID_USAGE_KEY, usage)) {
+        return false;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
+    return usage <= ZMK_HID_KEYBOARD_NKRO_MAX_USAGE;
+#else
+    return usage <= 0xFF;
+#endif
+}
+
+static bool contains(const zmk_key_t *keys, size_t len, zmk_key_t usage) {
+    for (size_t i = 0; i < len; i++) {
+        if (keys[i] == usage) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Time between two reports, so each report is read by the host before the next one replaces it
+static int frame_interval_ms() {
+    switch (zmk_endpoints_selected().transport) {
+#if IS_ENABLED(CONFIG_ZMK_USB)
+    case ZMK_TRANSPORT_USB:
+        return CONFIG_USB_HID_POLL_INTERVAL_MS;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+    case ZMK_TRANSPORT_BLE: {
+        int interval = zmk_ble_active_profile_conn_interval_ms();
+        if (interval > 0) {
+            return interval;
+        }
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+
+    return CONFIG_ZMK_TEXT_INJECT_DEFAULT_INTERVAL_MS;
+}
+
+static void release_frame_keys() {
+    for (size_t i = 0; i < frame_len; i++) {
+        zmk_hid_keyboard_release(frame_keys[i]);
+    }
+    frame_len = 0;
+}
+
+// Presses the next keys that the host will read in the order they were queued
+static void fill_frame(const zmk_key_t *released, size_t released_len) {
+    while (queue_len > 0 && frame_len < MAX_FRAME_KEYS) {
+        uint32_t keycode = queue[queue_head];
+        zmk_key_t usage = ZMK_HID_USAGE_ID(keycode);
+
+        if (SELECT_MODS(keycode) != frame_mods) {
+            break;
+        }
+
+        // The host only sees a key typed again once a report has released it. This includes keys
+        // that are held on the keyboard.
+        if (contains(released, released_len, usage) || zmk_hid_keyboard_is_pressed(usage)) {
+            break;
+        }
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
+        // Hosts read the bitmap from the lowest usage up
+        if (frame_len > 0 && usage < frame_keys[frame_len - 1]) {
+            break;
+        }
+#endif
+
+        // HKRO usages take the lowest free slot, so the slots are in the order the keys were typed
+        zmk_hid_keyboard_press(usage);
+        if (!zmk_hid_keyboard_is_pressed(usage)) {
+            // No free slot left, the key goes into a later report
+            break;
+        }
+
+        LOG_DBG("usage 0x%02X", usage);
+        frame_keys[frame_len++] = usage;
+        queue_head = (queue_head + 1) % ARRAY_SIZE(queue);
+        queue_len--;
+    }
+}
+
+static void inject_frame(struct k_work *work) {
+    zmk_key_t released[MAX_FRAME_KEYS];
+    size_t released_len = frame_len;
+
+    memcpy(released, frame_keys, frame_len * sizeof(zmk_key_t));
+    release_frame_keys();
+
+    if (released_len == 0 && queue_len == 0) {
+        injecting = false;
+        return;
+    }
+
+    // Modifiers change together with the keys that need them. If the next key needs other
+    // modifiers than the keys being released, this report only releases them, like &kp does.
+    if (queue_len > 0 && (released_len == 0 || SELECT_MODS(queue[queue_head]) == frame_mods)) {
+        frame_mods = SELECT_MODS(queue[queue_head]);
+        fill_frame(released, released_len);
+    } else {
+        frame_mods = 0;
+    }
+
+    zmk_hid_implicit_modifiers_press(frame_mods);
+
+    LOG_DBG("%d keys, modifiers 0x%02X", (int)frame_len, frame_mods);
+    int err = zmk_endpoints_send_report(HID_USAGE_KEY);
+    if (err < 0) {
+        LOG_WRN("Failed to send injected keys (err %d), dropping %d queued keys", err,
+                (int)queue_len);
+        release_frame_keys();
+        frame_mods = 0;
+        zmk_hid_implicit_modifiers_release();
+        queue_len = 0;
+        injecting = false;
+        return;
+    }
+
+    // Scheduled at absolute times, so a late work queue doesn't stretch the following reports
+    next_frame += frame_interval_ms();
+    k_work_schedule(&frame_work, K_TIMEOUT_ABS_MS(next_frame));
+}
+
+int zmk_text_inject(const uint32_t *keycodes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (!can_type(keycodes[i])) {
+            LOG_ERR("Cannot inject keycode 0x%08X", keycodes[i]);
+            return -EINVAL;
+        }
+    }
+
+    if (len > ARRAY_SIZE(queue) - queue_len) {
+        LOG_WRN("No room to inject %d keys, %d are still queued", (int)len, (int)queue_len);
+        return -ENOMEM;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        queue[(queue_head + queue_len++) % ARRAY_SIZE(queue)] = keycodes[i];
+    }
+
+    if (!injecting) {
+        injecting = true;
+        next_frame = k_uptime_get();
+        k_work_schedule(&frame_work, K_NO_WAIT);
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/timer_wheel.h>
+
+#define SLOT_COUNT CONFIG_ZMK_TIMER_WHEEL_SLOTS
+#define SLOT_MASK (SLOT_COUNT - 1)
+
+BUILD_ASSERT((SLOT_COUNT & SLOT_MASK) == 0, "CONFIG_ZMK_TIMER_WHEEL_SLOTS must be a power of two");
+
+// One slot per millisecond. A timer is kept in the slot of its deadline, and deadlines more than
+// SLOT_COUNT ms away share a slot with earlier ones, so a timer only expires once the wheel has
+// passed its deadline, not merely its slot.
+static sys_dlist_t slots[SLOT_COUNT];
+// Every timer with a deadline up to this time has been handled
+static int64_t processed_until;
+static uint32_t running_count;
+
+static struct k_work_delayable wheel_work;
+// Time the wheel work is scheduled at, or INT64_MAX if it isn't
+static int64_t scheduled_at = INT64_MAX;
+
+static void schedule_wheel(int64_t at) {
+    scheduled_at = at;
+    k_work_reschedule(&wheel_work, K_MSEC(MAX(at - k_uptime_get(), 0)));
+}
+
+static int64_t next_deadline() {
+    // Try the next lap of the wheel first, where the first timer found is the next to expire.
+    for (int64_t at = processed_until + 1; at <= processed_until + SLOT_COUNT; at++) {
+        struct zmk_timer *timer;
+        SYS_DLIST_FOR_EACH_CONTAINER(&slots[at & SLOT_MASK], timer, node) {
+            if (timer->deadline <= at) {
+                return at;
+            }
+        }
+    }
+
+    // All timers are further away than one lap.
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        struct zmk_timer *timer;
+        SYS_DLIST_FOR_EACH_CONTAINER(&slots[i], timer, node) {
+            next = MIN(next, timer->deadline);
+        }
+    }
+    return next;
+}
+
+static void expire_slot(int64_t at) {
+    sys_dlist_t expired;
+    struct zmk_timer *timer, *tmp;
+
+    sys_dlist_init(&expired);
+
+    SYS_DLIST_FOR_EACH_CONTAINER_SAFE(&slots[at & SLOT_MASK], timer, tmp, node) {
+        if (timer->deadline <= at) {
+            sys_dlist_remove(&timer->node);
+            sys_dlist_append(&expired, &timer->node);
+        }
+    }
+
+    // Handlers may stop or restart any timer, including the expired ones still in the list.
+    sys_dnode_t *node;
+    while ((node = sys_dlist_get(&expired)) != NULL) {
+        timer = CONTAINER_OF(node, struct zmk_timer, node);
+        running_count--;
+        timer->handler(timer);
+    }
+}
+
+static void wheel_work_handler(struct k_work *work) {
+    int64_t now = k_uptime_get();
+
+    scheduled_at = INT64_MAX;
+
+    // If the work ran more than a lap late, a single lap still visits every slot.
+    for (int64_t at = MAX(processed_until + 1, now - SLOT_MASK); at <= now; at++) {
+        processed_until = at;
+        expire_slot(at);
+    }
+
+    if (running_count > 0) {
+        schedule_wheel(next_deadline());
+    }
+}
+
+void zmk_timer_init(struct zmk_timer *timer, zmk_timer_handler_t handler) {
+    sys_dnode_init(&timer->node);
+    timer->deadline = 0;
+    timer->handler = handler;
+}
+
+void zmk_timer_start(struct zmk_timer *timer, int64_t deadline) {
+    zmk_timer_stop(timer);
+
+    if (running_count == 0) {
+        // Nothing to catch up on, so the wheel can skip ahead to the current time.
+        processed_until = MAX(processed_until, k_uptime_get() - 1);
+    }
+
+    // Deadlines that already passed go in the next slot the wheel will visit.
+    int64_t at = MAX(deadline, processed_until + 1);
+
+    timer->deadline = deadline;
+    sys_dlist_append(&slots[at & SLOT_MASK], &timer->node);
+    running_count++;
+
+    if (at < scheduled_at) {
+        schedule_wheel(at);
+    }
+}
+
+bool zmk_timer_stop(struct zmk_timer *timer) {
+    if (!sys_dnode_is_linked(&timer->node)) {
+        return false;
+    }
+
+    // The wheel work is left scheduled; it finds nothing to expire and goes idle.
+    sys_dlist_remove(&timer->node);
+    running_count--;
+    return true;
+}
+
+static int timer_wheel_init() {
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        sys_dlist_init(&slots[i]);
+    }
+    k_work_init_delayable(&wheel_work, wheel_work_handler);
+    return 0;
+}
+
+SYS_INIT(timer_wheel_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -10,7 +10,10 @@
 #include <zephyr/usb/usb_device.h>
 #include <zephyr/usb/class/usb_hid.h>
 
+#include <string.h>
+
 #include <zmk/usb.h>
+#include <zmk/usb_hid.h>
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
 #include <zmk/event_manager.h>
@@ -20,9 +23,243 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 static const struct device *hid_dev;
 
-static K_SEM_DEFINE(hid_sem, 1, 1);
+// Input reports, each with its own queue
+static const uint8_t input_report_ids[] = {
+    0x01,
+    0x02,
+    GEN_DESKTOP_REPORT_ID,
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    MOUSE_REPORT_ID,
+#endif
+};
+
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+#define MOUSE_REPORT_SIZE sizeof(struct zmk_hid_mouse_report)
+#else
+#define MOUSE_REPORT_SIZE 0
+#endif
+
+#define MAX_INPUT_REPORT_SIZE                                                                      \
+    MAX(MAX(sizeof(struct zmk_hid_keyboard_report), sizeof(struct zmk_hid_consumer_report)),       \
+        MAX(sizeof(struct zmk_hid_gen_desktop_report), MOUSE_REPORT_SIZE))
+
+// Longest time to wait for the host to read a report before assuming the in ready callback was
+// lost, and writing the next report anyway. Also how long to wait before writing a report again
+// when the endpoint was still busy.
+#define IN_READY_TIMEOUT_MS 30
+
+struct queued_report {
+    // Order in which the reports were sent, across all report IDs
+    uint32_t seq;
+    // Cycle count when the report was sent
+    uint32_t sent_at;
+    uint8_t len;
+    uint8_t data[MAX_INPUT_REPORT_SIZE];
+};
+
+struct report_queue {
+    struct queued_report reports[CONFIG_ZMK_USB_HID_REPORT_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;
+};
+
+// Reports that wait for the endpoint, one queue per report ID, so a burst of one report type
+// cannot push out the reports of another.
+static struct report_queue queues[ARRAY_SIZE(input_report_ids)];
+static uint32_t next_seq;
+
+// Set from the time a report is written until the host has read it
+static bool endpoint_busy;
+static int64_t busy_since;
+static uint32_t busy_sent_at;
+
+// Report taken from the queues to be written. If the endpoint was still busy, it stays here and is
+// written again before any queued report.
+static struct queued_report in_flight;
+static bool retry_in_flight;
+
+static struct zmk_usb_hid_stats stats;
+
+static struct k_spinlock lock;
+
+static void send_next_report(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(send_next_work, send_next_report);
+
+#if IS_ENABLED(CONFIG_ZMK_USB_HID_LATENCY_STATS)
+
+static uint8_t latency_bucket(uint32_t latency_us) {
+    if (latency_us == 0) {
+        return 0;
+    }
+    if (latency_us >= BIT(ZMK_USB_HID_LATENCY_BUCKETS - 2)) {
+        return ZMK_USB_HID_LATENCY_BUCKETS - 1;
+    }
+    return 32 - __builtin_clz(latency_us);
+}
+
+static void record_latency(uint32_t sent_at) {
+    uint8_t bucket = latency_bucket(k_cyc_to_us_floor32(k_cycle_get_32() - sent_at));
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    stats.latency_us[bucket]++;
+    k_spin_unlock(&lock, key);
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_USB_HID_LATENCY_STATS) */
+
+static void in_ready_cb(const struct device *dev) {
+#if IS_ENABLED(CONFIG_ZMK_USB_HID_LATENCY_STATS)
+    record_latency(busy_sent_at);
+#endif
+
+    // May be called from an interrupt, so the next report is written from the work queue
+    k_work_reschedule(&send_next_work, K_NO_WAIT);
+}
+
+static struct report_queue *find_queue(uint8_t report_id) {
+    for (int i = 0; i < ARRAY_SIZE(input_report_ids); i++) {
+        if (input_report_ids[i] == report_id) {
+            return &queues[i];
+        }
+    }
+    return NULL;
+}
+
+static int push_report(struct report_queue *queue, const uint8_t *report, size_t len,
+                       uint32_t sent_at) {
+    struct queued_report *slot;
+
+    if (queue->count < ARRAY_SIZE(queue->reports)) {
+        slot = &queue->reports[(queue->head + queue->count++) % ARRAY_SIZE(queue->reports)];
+    } else if (IS_ENABLED(CONFIG_ZMK_MOUSE) && report[0] == MOUSE_REPORT_ID) {
+        // Motion is relative, replacing a queued mouse report would lose its motion
+        return -EAGAIN;
+    } else {
+        // Latest state wins: replace the newest report of this type that is still queued
+        slot = &queue->reports[(queue->head + queue->count - 1) % ARRAY_SIZE(queue->reports)];
+        stats.merges++;
+    }
+
+    slot->seq = next_seq++;
+    slot->sent_at = sent_at;
+    slot->len = len;
+    memcpy(slot->data, report, len);
+    return 0;
+}
+
+static bool pop_oldest_report(struct queued_report *report) {
+    struct report_queue *oldest = NULL;
+
+    for (int i = 0; i < ARRAY_SIZE(queues); i++) {
+        struct report_queue *queue = &queues[i];
+        if (queue->count > 0 &&
+            (oldest == NULL || (int32_t)(queue->reports[queue->head].seq -
+                                         oldest->reports[oldest->head].seq) < 0)) {
+            oldest = queue;
+        }
+    }
+
+    if (oldest == NULL) {
+        return false;
+    }
+
+    *report = oldest->reports[oldest->head];
+    oldest->head = (oldest->head + 1) % ARRAY_SIZE(oldest->reports);
+    oldest->count--;
+    return true;
+}
+
+static void drop_queued_reports() {
+    for (int i = 0; i < ARRAY_SIZE(queues); i++) {
+        stats.drops += queues[i].count;
+        queues[i].count = 0;
+    }
+}
+
+// Called with the lock held. Takes the report to write next, and marks the endpoint busy with it.
+static bool claim_next_report() {
+    if (!retry_in_flight && !pop_oldest_report(&in_flight)) {
+        endpoint_busy = false;
+        return false;
+    }
+
+    retry_in_flight = false;
+    endpoint_busy = true;
+    busy_since = k_uptime_get();
+    busy_sent_at = in_flight.sent_at;
+    return true;
+}
+
+static void write_in_flight_report() {
+    int err = hid_int_ep_write(hid_dev, in_flight.data, in_flight.len, NULL);
+    if (err == 0) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (err == -EAGAIN || err == -EBUSY) {
+        // The host has not read the previous report yet. The in ready callback writes this one
+        // again, or the timer does if the callback was lost.
+        retry_in_flight = true;
+    } else {
+        // No in ready callback follows a failed write, the timer carries on with the queue
+        LOG_ERR("Failed to write USB HID report (%d)", err);
+        endpoint_busy = false;
+        stats.drops++;
+    }
+    k_spin_unlock(&lock, key);
 
-static void in_ready_cb(const struct device *dev) { k_sem_give(&hid_sem); }
+    k_work_schedule(&send_next_work, K_MSEC(IN_READY_TIMEOUT_MS));
+}
+
+static void send_next_report(struct k_work *work) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool claimed = claim_next_report();
+    k_spin_unlock(&lock, key);
+
+    if (claimed) {
+        write_in_flight_report();
+    }
+}
+
+static int queue_report(const uint8_t *report, size_t len) {
+    struct report_queue *queue = find_queue(report[0]);
+    if (len > MAX_INPUT_REPORT_SIZE || queue == NULL) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int err = push_report(queue, report, len, k_cycle_get_32());
+
+    if (endpoint_busy) {
+        stats.stalls++;
+
+        if (k_uptime_get() - busy_since > IN_READY_TIMEOUT_MS) {
+            LOG_WRN("No in ready callback for %dms, writing the next report anyway",
+                    IN_READY_TIMEOUT_MS);
+            busy_since = k_uptime_get();
+            k_work_reschedule(&send_next_work, K_NO_WAIT);
+        }
+
+        k_spin_unlock(&lock, key);
+        return err;
+    }
+
+    bool claimed = claim_next_report();
+    k_spin_unlock(&lock, key);
+
+    if (claimed) {
+        write_in_flight_report();
+    }
+    return err;
+}
+
+struct zmk_usb_hid_stats zmk_usb_hid_get_stats() {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    struct zmk_usb_hid_stats ret = stats;
+    k_spin_unlock(&lock, key);
+    return ret;
+}
 
 #ifdef CONFIG_USB_FEATURE_REPORTS
 
@@ -90,20 +327,48 @@ int zmk_usb_hid_send_report(const uint8_t *report, size_t len) {
     case USB_DC_ERROR:
     case USB_DC_RESET:
     case USB_DC_DISCONNECTED:
-    case USB_DC_UNKNOWN:
+    case USB_DC_UNKNOWN: {
+        // Reports queued for the old connection are stale by the time the host comes back
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        drop_queued_reports();
+        if (retry_in_flight) {
+            stats.drops++;
+            retry_in_flight = false;
+        }
+        endpoint_busy = false;
+        k_spin_unlock(&lock, key);
         return -ENODEV;
+    }
     default:
-        k_sem_take(&hid_sem, K_MSEC(30));
-        int err = hid_int_ep_write(hid_dev, report, len, NULL);
+        return queue_report(report, len);
+    }
+}
 
-        if (err) {
-            k_sem_give(&hid_sem);
-        }
+#if IS_ENABLED(CONFIG_ZMK_USB_HID_STATS_SHELL)
 
-        return err;
+#include <zephyr/shell/shell.h>
+
+static int cmd_usb_hid_stats(const struct shell *sh, size_t argc, char **argv) {
+    struct zmk_usb_hid_stats current = zmk_usb_hid_get_stats();
+
+    shell_print(sh, "stalls %u merges %u drops %u", current.stalls, current.merges, current.drops);
+
+#if IS_ENABLED(CONFIG_ZMK_USB_HID_LATENCY_STATS)
+    shell_print(sh, "Send to read latency in us: <1, then [2^(b-1), 2^b), the last one is >=%d",
+                (int)BIT(ZMK_USB_HID_LATENCY_BUCKETS - 2));
+    for (int b = 0; b < ZMK_USB_HID_LATENCY_BUCKETS; b++) {
+        shell_print(sh, "%2d %u", b, current.latency_us[b]);
     }
+#endif
+
+    return 0;
 }
 
+SHELL_CMD_REGISTER(usb_hid_stats, NULL, "Print the USB HID report queue counters",
+                   cmd_usb_hid_stats);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_USB_HID_STATS_SHELL) */
+
 static int zmk_usb_hid_init(const struct device *_arg) {
     hid_dev = device_get_binding("HID_0");
     if (hid_dev == NULL) {
@@ -29,6 +29,7 @@ module.exports = {
       "behaviors/mod-tap",
       "behaviors/mod-morph",
       "behaviors/macros",
+      "behaviors/text-injection",
       "behaviors/key-toggle",
       "behaviors/sticky-key",
       "behaviors/sticky-layer",
@@ -36,6 +37,7 @@ module.exports = {
       "behaviors/caps-word",
       "behaviors/key-repeat",
       "behaviors/sensor-rotate",
+      "behaviors/mouse-emulation",
       "behaviors/reset",
       "behaviors/bluetooth",
       "behaviors/outputs",